@@ -17,6 +17,7 @@
 
 #include "pgm/factor.hpp"
 #include "pgm/rv.hpp"
+#include "pgm/structured_cpd.hpp"
 
 using namespace std;
 
@@ -255,10 +256,39 @@ void example_jpd_inference() {
 }
 
 
+// noisy-OR with many parents: eliminating through the decomposition keeps
+// every intermediate factor over at most two variables, whereas the dense
+// CPD would have 2^(n_parents + 1) entries.
+void example_noisy_or() {
+  const int n_parents = 20;
+  pgm::rv Y(2);
+  std::vector<pgm::rv> parents;
+  std::vector<double> activation;
+  std::vector<pgm::factor> factors;
+  for (int i = 0; i < n_parents; ++i) {
+    parents.emplace_back(2);
+    activation.push_back(0.05 * (i % 5 + 1));
+    factors.push_back(pgm::factor(pgm::factor::rv_list {parents.back()},
+                                  {{0.9, 0.1}}));
+  }
+  auto cpd = pgm::make_noisy_or(Y, parents, activation, 0.01);
+  auto decomposition = cpd.decompose();
+  factors.insert(factors.end(),
+                 decomposition.factors.begin(),
+                 decomposition.factors.end());
+
+  auto elimination_order = parents;
+  elimination_order.push_back(decomposition.auxiliary);
+  auto f = factor_joint_product(sum_product_elimination(factors, elimination_order));
+  print_factor(f, "P(Y) for a 20-parent noisy-OR");
+}
+
+
 int main()
 {
   example_factor_operations();
   example_misconception();
   example_sum_product_ve();
+  example_noisy_or();
   return 0;
 }
@@ -0,0 +1,145 @@
+#ifndef PGM_CHUNKED_FACTOR_HPP
+#define PGM_CHUNKED_FACTOR_HPP
+// chunked_factor.hpp
+
+#include <cstddef>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "pgm/factor.hpp"
+#include "pgm/rv.hpp"
+
+namespace pgm
+{
+
+// mapped_file owns a file of a fixed number of bytes that is memory-mapped
+// for reading and writing.  It is move-only.
+class mapped_file
+{
+private:
+  std::string m_path;
+  int m_fd = -1;
+  std::size_t m_bytes = 0;
+  void* m_addr = nullptr;
+
+  void close();
+
+public:
+  // If create is true, the file is created (or truncated) and sized to bytes.
+  // Otherwise an existing file is opened, and it must hold at least bytes.
+  mapped_file(const std::string& path, std::size_t bytes, bool create);
+  mapped_file(mapped_file&& other) noexcept;
+  auto operator=(mapped_file&& other) noexcept -> mapped_file&;
+  mapped_file(const mapped_file&) = delete;
+  auto operator=(const mapped_file&) -> mapped_file& = delete;
+  ~mapped_file();
+
+  auto path() const -> const std::string& { return m_path; }
+  auto bytes() const -> std::size_t { return m_bytes; }
+  auto addr() const -> void* { return m_addr; }
+
+  // Hints to the kernel that a byte range will soon be read (prefetch),
+  // or that it is no longer needed and may be evicted (release).
+  void prefetch(std::size_t offset, std::size_t length) const;
+  void release(std::size_t offset, std::size_t length) const;
+};
+
+// chunked_factor models a discrete factor whose table lives on disk rather
+// than in an xt::xarray.  The table is stored row-major in sorted scope order
+// (the same layout as factor::data()), and it is divided into tiles.
+// A tile is one block of the trailing scope variables, so every tile fixes
+// an assignment to the leading variables and spans all trailing ones.
+//
+// Class invariants
+//   rv_id is in strictly ascending order
+//   elements of rv_id are not repeated
+//   tile_size() divides size()
+class chunked_factor
+{
+public:
+  using value_type = factor::value_type;
+  using rv_list = factor::rv_list;
+
+  // Default upper bound on the number of elements in one tile (8 MiB).
+  static constexpr std::size_t default_max_tile_size = std::size_t {1} << 20;
+
+private:
+  rv_list m_rand_vars;
+  std::size_t m_size;
+  std::size_t m_tile_size;
+  std::size_t m_tile_axes;  // number of trailing variables spanned by a tile
+  mapped_file m_file;
+
+  chunked_factor(const rv_list& rand_vars,
+                 const std::string& path,
+                 std::size_t max_tile_size,
+                 bool create);
+
+public:
+  // Creates a zero-filled chunked factor backed by a new file at path.
+  // Unlike factor, rand_vars must already be in ascending id order.
+  chunked_factor(const rv_list& rand_vars,
+                 const std::string& path,
+                 std::size_t max_tile_size = default_max_tile_size);
+
+  // Opens a chunked factor previously written to path with the same scope.
+  static auto open(const rv_list& rand_vars,
+                   const std::string& path,
+                   std::size_t max_tile_size = default_max_tile_size)
+      -> chunked_factor;
+
+  // Writes an in-memory factor to a new file at path.
+  static auto from_factor(const factor& f,
+                          const std::string& path,
+                          std::size_t max_tile_size = default_max_tile_size)
+      -> chunked_factor;
+
+  auto vars() const -> const rv_list& { return m_rand_vars; }
+  auto path() const -> const std::string& { return m_file.path(); }
+  auto size() const -> std::size_t { return m_size; }
+  auto tile_size() const -> std::size_t { return m_tile_size; }
+  auto tile_count() const -> std::size_t { return m_size / m_tile_size; }
+  auto tile_axes() const -> std::size_t { return m_tile_axes; }
+
+  auto values() const -> std::span<const value_type>;
+  auto values() -> std::span<value_type>;
+  auto tile(std::size_t t) const -> std::span<const value_type>;
+  auto tile(std::size_t t) -> std::span<value_type>;
+
+  // Hints for streaming: load a range of elements ahead of use, or drop it
+  // from the working set once it has been consumed.
+  void prefetch(std::size_t first, std::size_t count) const;
+  void release(std::size_t first, std::size_t count) const;
+
+  // Loads the whole table into memory.  Only sensible for small results.
+  auto to_factor() const -> factor;
+};
+
+// Out-of-core counterparts of the factor operations in factor.hpp.  Each one
+// writes its result to a new file at path and streams through its operands
+// one output (or input) tile at a time, so working memory is bounded by the
+// tile size rather than by the size of the tables.  Creating the result
+// truncates path, so it must not be the file of an operand.
+auto chunked_factor_product(
+    const chunked_factor& f_a,
+    const chunked_factor& f_b,
+    const std::string& path,
+    std::size_t max_tile_size = chunked_factor::default_max_tile_size)
+    -> chunked_factor;
+auto chunked_factor_reduction(
+    const chunked_factor& input,
+    const pgm::rv_evidence& assignments,
+    const std::string& path,
+    std::size_t max_tile_size = chunked_factor::default_max_tile_size)
+    -> chunked_factor;
+auto chunked_factor_marginalization(
+    const chunked_factor& input,
+    const std::vector<pgm::rv>& summation_rvs,
+    const std::string& path,
+    std::size_t max_tile_size = chunked_factor::default_max_tile_size)
+    -> chunked_factor;
+
+}  // namespace pgm
+
+#endif  // PGM_CHUNKED_FACTOR_HPP
@@ -0,0 +1,132 @@
+#ifndef PGM_LEARNING_HPP
+#define PGM_LEARNING_HPP
+// learning.hpp
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <vector>
+
+#include "pgm/chunked_factor.hpp"
+#include "pgm/factor.hpp"
+#include "pgm/rv.hpp"
+
+namespace pgm
+{
+
+// A family is a child variable together with its parents.  In a Bayesian
+// network each family carries one CPD, P(child | parents), whose scope is
+// the family scope.
+struct family
+{
+  pgm::rv child;
+  factor::rv_list parents;
+
+  // The child and its parents in ascending id order.
+  auto scope() const -> factor::rv_list;
+};
+
+// assignment_table is a read-only view of a row-major matrix of observed
+// values: one row per sample, one column per random variable.
+// A negative entry marks a missing observation.  Non-negative entries must
+// be less than the cardinality of their column's variable; the learning
+// functions throw on a row that breaks this.
+class assignment_table
+{
+public:
+  using value_type = std::int32_t;
+
+private:
+  std::span<const value_type> m_values;
+  factor::rv_list m_columns;
+  std::size_t m_rows;
+
+public:
+  assignment_table(std::span<const value_type> values,
+                   const factor::rv_list& columns);
+
+  auto rows() const -> std::size_t { return m_rows; }
+  auto columns() const -> const factor::rv_list& { return m_columns; }
+  auto row(std::size_t i) const -> std::span<const value_type>
+  {
+    return m_values.subspan(i * m_columns.size(), m_columns.size());
+  }
+  auto column_of(pgm::rv v) const -> std::size_t;
+};
+
+// assignment_file memory-maps a raw file of assignment_table::value_type
+// values written row by row, so datasets larger than RAM can be streamed.
+class assignment_file
+{
+private:
+  factor::rv_list m_columns;
+  std::size_t m_rows;
+  mapped_file m_file;
+
+  assignment_file(const factor::rv_list& columns,
+                  std::size_t rows,
+                  mapped_file file);
+
+public:
+  static auto open(const std::string& path, const factor::rv_list& columns)
+      -> assignment_file;
+  auto table() const -> assignment_table;
+};
+
+// Counts how often each assignment to each family's scope occurs in data.
+// Rows with a missing value inside a family's scope are skipped for that
+// family.  Rows are split across n_threads threads (0 selects the hardware
+// concurrency), each filling its own count tables, which are summed at the end.
+auto count_families(const assignment_table& data,
+                    const std::vector<family>& families,
+                    unsigned n_threads = 0) -> std::vector<factor>;
+
+// Turns a count table over a family scope into the CPD P(child | parents),
+// after adding pseudocount to every cell.  Parent configurations that were
+// never observed get a uniform distribution over the child.
+auto conditional_normalization(const factor& counts,
+                               pgm::rv child,
+                               factor::value_type pseudocount = 0.) -> factor;
+
+// Maximum-likelihood (or, with a pseudocount, Dirichlet-smoothed) CPDs
+// for each family, from the rows that observe the family's whole scope.
+auto fit_cpds(const assignment_table& data,
+              const std::vector<family>& families,
+              factor::value_type pseudocount = 0.,
+              unsigned n_threads = 0) -> std::vector<factor>;
+
+struct em_options
+{
+  int max_iterations = 100;
+  // Stop once no CPD entry moves by more than this between iterations.
+  double tolerance = 1e-6;
+  factor::value_type pseudocount = 1.;
+  unsigned n_threads = 0;
+  // Above this many distinct partially observed rows, the E-step visits
+  // rows one at a time instead of keeping a table of patterns.
+  std::size_t max_patterns = std::size_t {1} << 20;
+};
+
+struct em_result
+{
+  std::vector<factor> cpds;
+  double log_likelihood;  // of the observed data, before the last M-step
+  int iterations;
+  bool converged;
+};
+
+// Expectation-maximization for data with missing values.  The families must
+// form a Bayesian network over data.columns().  Partially observed rows are
+// grouped by their observed values so that each distinct pattern needs one
+// posterior computation per iteration; patterns are processed in parallel.
+// If initial_cpds is empty, EM starts from fit_cpds(), which uses every row
+// that observes each family's own scope.
+auto fit_cpds_em(const assignment_table& data,
+                 const std::vector<family>& families,
+                 const std::vector<factor>& initial_cpds = {},
+                 const em_options& options = {}) -> em_result;
+
+}  // namespace pgm
+
+#endif  // PGM_LEARNING_HPP
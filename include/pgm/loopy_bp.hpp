@@ -0,0 +1,94 @@
+#ifndef PGM_LOOPY_BP_HPP
+#define PGM_LOOPY_BP_HPP
+// loopy_bp.hpp
+
+#include <cstddef>
+#include <vector>
+
+#include "pgm/factor.hpp"
+#include "pgm/rv.hpp"
+
+namespace pgm
+{
+
+struct bp_options
+{
+  // Weight kept from the old message: m <- (1 - damping) m_new + damping m.
+  double damping = 0.;
+  // Stop once no pending message differs from its current value by more
+  // than this (max absolute difference of normalized entries).
+  double tolerance = 1e-6;
+  std::size_t max_updates = 1000000;
+};
+
+struct bp_result
+{
+  std::size_t updates;
+  double max_residual;
+  bool converged;
+};
+
+// cluster_graph runs sum-product belief propagation on a graph of clusters
+// (each with an initial potential) joined by edges labelled with sepsets.
+// On a tree this is exact; on loopy graphs it is loopy BP.
+//
+// Messages are scheduled by residual: every directed edge keeps its next
+// message ready, and the one that differs most from the current message is
+// sent first.
+//
+// Message and belief tables are flat buffers sized when clusters and edges
+// are added, and run() overwrites them in place.  Sending a message into a
+// cluster recomputes that cluster's belief once; each of its outgoing
+// messages is then the belief divided by the message that came in over the
+// same edge, summed down to the sepset.  An update therefore costs
+// O(deg * |cluster|) rather than a product over the incoming messages for
+// every outgoing edge.
+class cluster_graph
+{
+private:
+  using table = std::vector<factor::value_type>;
+
+  struct directed_edge
+  {
+    std::size_t from;
+    std::size_t to;
+    factor::rv_list sepset;
+    // For each entry of the source cluster's table, its sepset entry.
+    std::vector<std::size_t> sepset_index;
+  };
+
+  std::vector<factor> m_potentials;
+  std::vector<table> m_potential_values;
+  std::vector<directed_edge> m_edges;  // edge i ^ 1 is the reverse of edge i
+  std::vector<std::vector<std::size_t>> m_incoming;  // edge indices, per cluster
+  std::vector<std::vector<std::size_t>> m_outgoing;
+  std::vector<table> m_messages;
+  std::vector<table> m_pending;  // next message to send along each edge
+  std::vector<table> m_beliefs;  // unnormalized, as of the last update
+
+  void compute_belief(std::size_t cluster, table& out) const;
+  void compute_message(std::size_t edge);
+
+public:
+  // Adds a cluster and returns its index.
+  auto add_cluster(const factor& potential) -> std::size_t;
+  // Joins two clusters.  The sepset must lie in both clusters' scopes.
+  void add_edge(std::size_t a, std::size_t b, const factor::rv_list& sepset);
+
+  // The Bethe cluster graph: one cluster per factor, one per variable,
+  // and an edge from each factor to each variable in its scope.
+  static auto bethe(const std::vector<factor>& factors) -> cluster_graph;
+
+  auto cluster_count() const -> std::size_t { return m_potentials.size(); }
+
+  auto run(const bp_options& options = {}) -> bp_result;
+
+  // Normalized belief of one cluster, and the marginal of one variable
+  // taken from the smallest cluster that contains it.
+  auto belief(std::size_t cluster) const -> factor;
+  auto marginal(pgm::rv v) const -> factor;
+};
+
+}  // namespace pgm
+
+#endif  // PGM_LOOPY_BP_HPP
@@ -0,0 +1,108 @@
+#ifndef PGM_SAMPLING_HPP
+#define PGM_SAMPLING_HPP
+// sampling.hpp
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "pgm/factor.hpp"
+#include "pgm/learning.hpp"
+#include "pgm/rv.hpp"
+#include "pgm/structured_cpd.hpp"
+
+namespace pgm
+{
+
+struct sampling_options
+{
+  std::uint64_t seed = 0;
+  unsigned n_threads = 0;
+  // Stop early, with the samples drawn so far, once this time has passed.
+  std::optional<std::chrono::steady_clock::time_point> deadline;
+};
+
+struct likelihood_weighting_options : sampling_options
+{
+  std::size_t max_samples = std::size_t {1} << 20;
+  std::size_t batch_size = 4096;
+};
+
+struct gibbs_options : sampling_options
+{
+  std::size_t n_chains = 64;
+  std::size_t burn_in = 100;  // sweeps discarded at the start of each chain
+  std::size_t max_sweeps = 1000;  // sweeps kept per chain
+  std::size_t sweeps_per_round = 10;  // deadline checks happen between rounds
+};
+
+// An estimated marginal over one query variable.  variance holds the
+// estimated variance of each entry of estimate.
+struct sample_estimate
+{
+  factor estimate;
+  factor variance;
+  std::size_t samples;
+};
+
+// network_sampler draws samples from a Bayesian network given as one
+// family and one CPD per variable (as produced by fit_cpds()).
+//
+// Each row of each CPD is precomputed as an alias table, so drawing a
+// variable costs O(1) whatever its cardinality.  Randomness comes from a
+// counter-based generator keyed by the seed and the sample (or chain)
+// index, so a given seed produces the same estimate for any thread count.
+class network_sampler
+{
+private:
+  struct node
+  {
+    pgm::rv var;
+    std::vector<std::size_t> parents;  // node indices
+    std::vector<std::size_t> row_strides;
+    std::vector<std::size_t> children;  // node indices
+    std::vector<double> table;  // P(var = x | row) at [row * card + x]
+    std::vector<double> alias_prob;
+    std::vector<std::uint32_t> alias;
+    // Noisy-MAX nodes have no table.  P(var <= y | parents) is
+    // leak_cdf[y] * prod_i level_cdfs[i][x_i * card + y].
+    std::vector<double> leak_cdf;
+    std::vector<std::vector<double>> level_cdfs;
+  };
+
+  std::vector<node> m_nodes;  // in topological order
+
+  auto node_of(pgm::rv v) const -> std::size_t;
+  // The observed value of each node, or -1.  Throws on out-of-range values.
+  auto clamp_values(const pgm::rv_evidence& evidence) const -> std::vector<int>;
+
+public:
+  // Noisy-MAX CPDs (see structured_cpd.hpp) may be given separately; each
+  // adds the family of its child and parents.  They are sampled from their
+  // parameters, at O(card * parents) per draw, without a dense table.
+  network_sampler(const std::vector<family>& families,
+                  const std::vector<factor>& cpds,
+                  const std::vector<noisy_max_cpd>& noisy_max_cpds = {});
+
+  // Importance sampling with the evidence clamped and each sample weighted
+  // by the likelihood of the evidence.  Samples are drawn in batches, one
+  // variable at a time across the whole batch.
+  auto likelihood_weighting(pgm::rv query,
+                            const pgm::rv_evidence& evidence,
+                            const likelihood_weighting_options& options = {})
+      const -> sample_estimate;
+
+  // Gibbs sampling over independent chains, each resampling every
+  // unobserved variable from its Markov blanket once per sweep.  Burn-in
+  // runs in rounds too; if the deadline passes before any sweep is kept,
+  // the estimate comes from the chains' current states.
+  auto gibbs(pgm::rv query,
+             const pgm::rv_evidence& evidence,
+             const gibbs_options& options = {}) const -> sample_estimate;
+};
+
+}  // namespace pgm
+
+#endif  // PGM_SAMPLING_HPP
@@ -0,0 +1,88 @@
+#ifndef PGM_STRUCTURE_HPP
+#define PGM_STRUCTURE_HPP
+// structure.hpp
+
+#include <atomic>
+#include <cstddef>
+#include <map>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+#include "pgm/factor.hpp"
+#include "pgm/learning.hpp"
+#include "pgm/rv.hpp"
+
+namespace pgm
+{
+
+enum class score_type
+{
+  bic,
+  bdeu,
+};
+
+// Decomposable score of one family, computed from its count table
+// (see count_families()).  Larger is better.
+// equivalent_sample_size is the BDeu prior strength; BIC ignores it.
+auto family_score(const factor& counts,
+                  pgm::rv child,
+                  score_type type,
+                  double equivalent_sample_size = 1.) -> double;
+
+// family_score_cache memoizes family scores over a fixed dataset, keyed by
+// the child and its parent set.  A structure search move only changes one
+// or two families, so every other family's score is a cache hit.
+// score() may be called concurrently from several threads.  The cache
+// keeps its own copy of the data view, so only the underlying values (for
+// example an assignment_file) need to outlive it.
+class family_score_cache
+{
+private:
+  using key_type = std::pair<int, std::vector<int>>;
+
+  assignment_table m_data;
+  score_type m_type;
+  double m_equivalent_sample_size;
+  mutable std::shared_mutex m_mutex;
+  std::map<key_type, double> m_scores;
+  std::atomic<std::size_t> m_hits = 0;
+  std::atomic<std::size_t> m_misses = 0;
+
+public:
+  family_score_cache(const assignment_table& data,
+                     score_type type,
+                     double equivalent_sample_size = 1.);
+
+  auto score(const family& fam) -> double;
+  auto hits() const -> std::size_t { return m_hits; }
+  auto misses() const -> std::size_t { return m_misses; }
+};
+
+struct hill_climb_options
+{
+  score_type score = score_type::bic;
+  double equivalent_sample_size = 1.;
+  std::size_t max_parents = 3;
+  int max_iterations = 1000;
+  unsigned n_threads = 0;
+};
+
+struct hill_climb_result
+{
+  // One family per column of the data, in column order.
+  std::vector<family> families;
+  double score;
+  int iterations;
+};
+
+// Greedy hill climbing over DAGs on the columns of data, starting from the
+// empty graph.  Each iteration scores every legal edge addition, removal
+// and reversal in parallel and applies the best one, until no move
+// improves the score.
+auto hill_climb(const assignment_table& data,
+                const hill_climb_options& options = {}) -> hill_climb_result;
+
+}  // namespace pgm
+
+#endif  // PGM_STRUCTURE_HPP
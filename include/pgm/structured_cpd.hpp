@@ -0,0 +1,145 @@
+#ifndef PGM_STRUCTURED_CPD_HPP
+#define PGM_STRUCTURED_CPD_HPP
+// structured_cpd.hpp
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+#include "pgm/factor.hpp"
+#include "pgm/rv.hpp"
+
+namespace pgm
+{
+
+// A noisy-MAX CPD decomposed into small factors (see noisy_max_cpd).
+// Summing the auxiliary variable out of the product of factors gives the
+// CPD, so the factors can go straight into variable elimination.
+struct noisy_max_decomposition
+{
+  pgm::rv auxiliary;
+  std::vector<factor> factors;
+};
+
+// noisy_max_cpd models P(child | parents) for a graded child with values
+// 0..K-1 where each parent acts independently: parent i in state x_i
+// produces a level Z_i ~ P(Z_i | x_i), a leak produces Z_0 ~ P(Z_0), and
+// the child takes the largest level, child = max(Z_0, Z_1, ...).
+// Noisy-OR is the binary case (see make_noisy_or()).
+//
+// Storage is linear in the number of parents, where a dense table would be
+// exponential.  network_sampler samples these CPDs directly; cluster_graph
+// only takes dense factors.
+class noisy_max_cpd
+{
+private:
+  pgm::rv m_child;
+  factor::rv_list m_parents;
+  // Per parent, P(Z_i = z | X_i = x) at [x * K + z].
+  std::vector<std::vector<factor::value_type>> m_levels;
+  std::vector<factor::value_type> m_leak;  // P(Z_0 = z)
+
+public:
+  noisy_max_cpd(pgm::rv child,
+                const factor::rv_list& parents,
+                const std::vector<std::vector<factor::value_type>>& levels,
+                const std::vector<factor::value_type>& leak);
+
+  auto child() const -> pgm::rv { return m_child; }
+  auto parents() const -> const factor::rv_list& { return m_parents; }
+  auto levels() const -> const std::vector<std::vector<factor::value_type>>&
+  {
+    return m_levels;
+  }
+  auto leak() const -> const std::vector<factor::value_type>& { return m_leak; }
+
+  // Uses P(child <= y | x) = P(Z_0 <= y) * prod_i P(Z_i <= y | x_i), then
+  // P(child = y | x) = P(child <= y | x) - P(child <= y - 1 | x).
+  // This creates a new auxiliary variable Y' with the child's cardinality
+  // and returns the factors
+  //   D(child, Y')  = 1 if Y' = child, -1 if Y' = child - 1, else 0,
+  //   C_0(Y')       = P(Z_0 <= Y'),
+  //   C_i(X_i, Y')  = P(Z_i <= Y' | X_i)   for each parent.
+  // Their total size is K^2 + K + K * sum_i |X_i|.
+  //
+  // D has negative entries, so the factors are only for sum-product
+  // variable elimination.  cluster_graph normalizes messages and needs
+  // non-negative potentials; give it to_factor() instead.
+  auto decompose() const -> noisy_max_decomposition;
+
+  // The equivalent dense CPD.  Exponential in the number of parents; meant
+  // for small models and for checking.
+  auto to_factor() const -> factor;
+};
+
+// Binary noisy-OR: parent i, when in state 1, turns the child on with
+// probability activation[i]; the leak turns it on with probability leak.
+// All variables must be binary.
+auto make_noisy_or(pgm::rv child,
+                   const factor::rv_list& parents,
+                   const std::vector<factor::value_type>& activation,
+                   factor::value_type leak = 0.) -> noisy_max_cpd;
+
+// tree_cpd models P(child | parents) as a decision tree.  Internal nodes
+// test one parent and branch on its value; leaves hold a distribution over
+// the child.  A parent that a branch never tests is irrelevant in that
+// context (context-specific independence), so the tree can be much smaller
+// than the dense table.  network_sampler and cluster_graph take the tree
+// through to_factor().
+class tree_cpd
+{
+public:
+  struct node
+  {
+    std::optional<pgm::rv> test;  // empty at a leaf
+    std::vector<node> branches;  // one per value of test
+    std::vector<factor::value_type> distribution;  // at a leaf
+  };
+
+  static auto leaf(const std::vector<factor::value_type>& distribution) -> node;
+  static auto split(pgm::rv test, const std::vector<node>& branches) -> node;
+
+private:
+  pgm::rv m_child;
+  node m_root;
+  factor::rv_list m_parents;
+
+public:
+  tree_cpd(pgm::rv child, const node& root);
+
+  auto child() const -> pgm::rv { return m_child; }
+  auto root() const -> const node& { return m_root; }
+  // Every variable tested somewhere in the tree, in ascending id order.
+  auto parents() const -> const factor::rv_list& { return m_parents; }
+
+  // Observing a parent selects its branch wherever it is tested, which can
+  // remove other parents from the tree entirely.
+  auto reduction(const pgm::rv_evidence& assignments) const -> tree_cpd;
+
+  // Sums a parent out against a distribution over it (normalized first):
+  // sum_x prior(x) P(child | parent = x, ...).  Each split on the parent
+  // becomes the weighted mixture of its branches, so the result stays a
+  // tree and is never expanded to a dense table.  Together with
+  // reduction(), this eliminates parents whose priors are independent of
+  // the other parents.
+  auto marginalization(pgm::rv parent, const factor& prior) const
+      -> tree_cpd;
+
+  // Number of probabilities stored in the leaves.
+  auto size() const -> std::size_t;
+
+  // One factor per leaf, over the variables tested on the path to that leaf
+  // and the child.  It holds the leaf's distribution where the path's
+  // context holds and 1 elsewhere, so the product of the rule factors is
+  // the CPD.  Each factor is dense over its scope, so together they can be
+  // larger than to_factor(); use reduction() and marginalization() to work
+  // on the compact tree.
+  auto rule_factors() const -> std::vector<factor>;
+
+  // The equivalent dense CPD.
+  auto to_factor() const -> factor;
+};
+
+}  // namespace pgm
+
+#endif  // PGM_STRUCTURED_CPD_HPP
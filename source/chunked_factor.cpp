@@ -0,0 +1,483 @@
+// chunked_factor.cpp
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <system_error>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "pgm/chunked_factor.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "pgm/factor.hpp"
+#include "pgm/rv.hpp"
+#include "scope_layout.hpp"
+
+namespace pgm
+{
+
+namespace
+{
+
+auto system_error_message(const std::string& what, const std::string& path)
+    -> std::string
+{
+  return what + " '" + path + "': " + std::strerror(errno);
+}
+
+auto page_size() -> std::size_t
+{
+  static const auto size = static_cast<std::size_t>(::sysconf(_SC_PAGESIZE));
+  return size;
+}
+
+// The size of a chunked factor's scope.  Called before the backing file is
+// created, so a bad scope throws without touching the file system.
+auto checked_scope_size(const factor::rv_list& vars) -> std::size_t
+{
+  if (std::adjacent_find(vars.begin(),
+                         vars.end(),
+                         [](auto a, auto b) { return a.id() >= b.id(); })
+      != vars.end())
+  {
+    throw std::runtime_error(
+        "A chunked factor's scope must be in strictly ascending id order.");
+  }
+  return detail::scope_size(vars);
+}
+
+// Creating the output truncates its file, so it must not be an operand.
+void check_output_path(const std::string& path, const chunked_factor& operand)
+{
+  std::error_code ec;
+  if (path == operand.path()
+      || std::filesystem::equivalent(path, operand.path(), ec))
+  {
+    throw std::runtime_error("Output path '" + path
+                             + "' is the file of an operand.");
+  }
+}
+
+// For each variable of iter_vars, the stride of that variable within the
+// layout of operand_vars, or 0 if the operand does not depend on it.
+auto operand_strides(const factor::rv_list& iter_vars,
+                     const factor::rv_list& operand_vars)
+    -> std::vector<std::size_t>
+{
+  auto strides = detail::scope_strides(operand_vars);
+  std::vector<std::size_t> result;
+  result.reserve(iter_vars.size());
+  for (auto v : iter_vars) {
+    auto it = std::find(operand_vars.begin(), operand_vars.end(), v);
+    result.push_back(it == operand_vars.end() ? 0
+                                              : strides[it - operand_vars.begin()]);
+  }
+  return result;
+}
+
+// scope_cursor walks the flat (row-major) indices of an iteration scope and
+// tracks, for each operand, the matching element offset in that operand.
+// Advancing costs amortized O(1) per step instead of an unravel per element.
+class scope_cursor
+{
+private:
+  std::vector<std::size_t> m_shape;
+  std::vector<std::size_t> m_index;
+  std::vector<std::vector<std::size_t>> m_strides;
+  std::vector<std::size_t> m_offsets;
+
+public:
+  scope_cursor(const factor::rv_list& iter_vars,
+               std::vector<std::vector<std::size_t>> strides,
+               std::size_t flat_start)
+      : m_index(iter_vars.size())
+      , m_strides(std::move(strides))
+      , m_offsets(m_strides.size(), 0)
+  {
+    for (auto v : iter_vars) {
+      m_shape.push_back(static_cast<std::size_t>(v.card()));
+    }
+    for (auto axis = m_shape.size(); axis-- > 0;) {
+      m_index[axis] = flat_start % m_shape[axis];
+      flat_start /= m_shape[axis];
+      for (std::size_t k = 0; k < m_strides.size(); ++k) {
+        m_offsets[k] += m_index[axis] * m_strides[k][axis];
+      }
+    }
+  }
+
+  auto offset(std::size_t operand) const -> std::size_t
+  {
+    return m_offsets[operand];
+  }
+
+  // Largest offset into an operand reachable by varying only the trailing
+  // `axes` iteration variables from the current position.
+  auto trailing_extent(std::size_t operand, std::size_t axes) const
+      -> std::size_t
+  {
+    std::size_t extent = 0;
+    for (auto axis = m_shape.size() - axes; axis < m_shape.size(); ++axis) {
+      extent += (m_shape[axis] - 1) * m_strides[operand][axis];
+    }
+    return extent;
+  }
+
+  void next()
+  {
+    for (auto axis = m_shape.size(); axis-- > 0;) {
+      ++m_index[axis];
+      for (std::size_t k = 0; k < m_strides.size(); ++k) {
+        m_offsets[k] += m_strides[k][axis];
+      }
+      if (m_index[axis] < m_shape[axis]) {
+        return;
+      }
+      for (std::size_t k = 0; k < m_strides.size(); ++k) {
+        m_offsets[k] -= m_shape[axis] * m_strides[k][axis];
+      }
+      m_index[axis] = 0;
+    }
+  }
+};
+
+// Prefetches the part of an operand that output tile t will read.
+void prefetch_operand(const chunked_factor& operand,
+                      const chunked_factor& output,
+                      const std::vector<std::size_t>& strides,
+                      std::size_t t)
+{
+  if (t >= output.tile_count()) {
+    return;
+  }
+  scope_cursor cursor(output.vars(), {strides}, t * output.tile_size());
+  operand.prefetch(cursor.offset(0),
+                   cursor.trailing_extent(0, output.tile_axes()) + 1);
+}
+
+}  // namespace
+
+
+mapped_file::mapped_file(const std::string& path, std::size_t bytes, bool create)
+    : m_path(path)
+    , m_bytes(bytes)
+{
+  if (bytes == 0) {
+    throw std::runtime_error("Cannot map an empty file '" + path + "'.");
+  }
+  m_fd = create ? ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644)
+                : ::open(path.c_str(), O_RDWR);
+  if (m_fd < 0) {
+    throw std::runtime_error(system_error_message("Cannot open", path));
+  }
+  if (create) {
+    if (::ftruncate(m_fd, static_cast<off_t>(bytes)) != 0) {
+      auto message = system_error_message("Cannot resize", path);
+      close();
+      throw std::runtime_error(message);
+    }
+  } else {
+    struct stat st {};
+    if (::fstat(m_fd, &st) != 0 || static_cast<std::size_t>(st.st_size) < bytes)
+    {
+      close();
+      throw std::runtime_error("File '" + path
+                               + "' is smaller than the requested mapping.");
+    }
+  }
+  m_addr = ::mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+  if (m_addr == MAP_FAILED) {
+    m_addr = nullptr;
+    auto message = system_error_message("Cannot map", path);
+    close();
+    throw std::runtime_error(message);
+  }
+}
+
+mapped_file::mapped_file(mapped_file&& other) noexcept
+    : m_path(std::move(other.m_path))
+    , m_fd(std::exchange(other.m_fd, -1))
+    , m_bytes(std::exchange(other.m_bytes, 0))
+    , m_addr(std::exchange(other.m_addr, nullptr))
+{
+}
+
+auto mapped_file::operator=(mapped_file&& other) noexcept -> mapped_file&
+{
+  if (this != &other) {
+    close();
+    m_path = std::move(other.m_path);
+    m_fd = std::exchange(other.m_fd, -1);
+    m_bytes = std::exchange(other.m_bytes, 0);
+    m_addr = std::exchange(other.m_addr, nullptr);
+  }
+  return *this;
+}
+
+mapped_file::~mapped_file()
+{
+  close();
+}
+
+void mapped_file::close()
+{
+  if (m_addr != nullptr) {
+    ::munmap(m_addr, m_bytes);
+    m_addr = nullptr;
+  }
+  if (m_fd >= 0) {
+    ::close(m_fd);
+    m_fd = -1;
+  }
+}
+
+void mapped_file::prefetch(std::size_t offset, std::size_t length) const
+{
+  auto first = offset / page_size() * page_size();
+  auto last = std::min(offset + length, m_bytes);
+  if (m_addr != nullptr && first < last) {
+    ::madvise(static_cast<char*>(m_addr) + first, last - first, MADV_WILLNEED);
+  }
+}
+
+void mapped_file::release(std::size_t offset, std::size_t length) const
+{
+  // Only whole pages inside the range may be dropped; partial pages at
+  // either end may still be shared with a neighbouring tile.
+  auto first = (offset + page_size() - 1) / page_size() * page_size();
+  auto last = std::min(offset + length, m_bytes) / page_size() * page_size();
+  if (m_addr != nullptr && first < last) {
+    ::madvise(static_cast<char*>(m_addr) + first, last - first, MADV_DONTNEED);
+  }
+}
+
+
+chunked_factor::chunked_factor(const rv_list& rand_vars,
+                               const std::string& path,
+                               std::size_t max_tile_size,
+                               bool create)
+    : m_rand_vars(rand_vars)
+    , m_size(checked_scope_size(rand_vars))
+    , m_tile_size(1)
+    , m_tile_axes(0)
+    , m_file(path, m_size * sizeof(value_type), create)
+{
+  // Grow the tile over trailing variables while it fits the budget.
+  // A tile always spans at least the last variable.
+  for (auto i = m_rand_vars.size(); i-- > 0;) {
+    auto card = static_cast<std::size_t>(m_rand_vars[i].card());
+    if (m_tile_axes > 0 && m_tile_size * card > max_tile_size) {
+      break;
+    }
+    m_tile_size *= card;
+    ++m_tile_axes;
+  }
+}
+
+chunked_factor::chunked_factor(const rv_list& rand_vars,
+                               const std::string& path,
+                               std::size_t max_tile_size)
+    : chunked_factor(rand_vars, path, max_tile_size, true)
+{
+}
+
+auto chunked_factor::open(const rv_list& rand_vars,
+                          const std::string& path,
+                          std::size_t max_tile_size) -> chunked_factor
+{
+  return chunked_factor(rand_vars, path, max_tile_size, false);
+}
+
+auto chunked_factor::from_factor(const factor& f,
+                                 const std::string& path,
+                                 std::size_t max_tile_size) -> chunked_factor
+{
+  chunked_factor result(f.vars(), path, max_tile_size);
+  std::copy(f.data().begin(), f.data().end(), result.values().begin());
+  return result;
+}
+
+auto chunked_factor::values() const -> std::span<const value_type>
+{
+  return {static_cast<const value_type*>(m_file.addr()), m_size};
+}
+
+auto chunked_factor::values() -> std::span<value_type>
+{
+  return {static_cast<value_type*>(m_file.addr()), m_size};
+}
+
+auto chunked_factor::tile(std::size_t t) const -> std::span<const value_type>
+{
+  return values().subspan(t * m_tile_size, m_tile_size);
+}
+
+auto chunked_factor::tile(std::size_t t) -> std::span<value_type>
+{
+  return values().subspan(t * m_tile_size, m_tile_size);
+}
+
+void chunked_factor::prefetch(std::size_t first, std::size_t count) const
+{
+  m_file.prefetch(first * sizeof(value_type), count * sizeof(value_type));
+}
+
+void chunked_factor::release(std::size_t first, std::size_t count) const
+{
+  m_file.release(first * sizeof(value_type), count * sizeof(value_type));
+}
+
+auto chunked_factor::to_factor() const -> factor
+{
+  std::vector<std::size_t> shape;
+  std::transform(m_rand_vars.begin(),
+                 m_rand_vars.end(),
+                 std::back_inserter(shape),
+                 [](auto v) { return static_cast<std::size_t>(v.card()); });
+  auto data = factor::data_array::from_shape(shape);
+  std::copy(values().begin(), values().end(), data.begin());
+  return factor(m_rand_vars, data);
+}
+
+
+auto chunked_factor_product(const chunked_factor& f_a,
+                            const chunked_factor& f_b,
+                            const std::string& path,
+                            std::size_t max_tile_size) -> chunked_factor
+{
+  factor::rv_list product_vars;
+  std::set_union(f_a.vars().begin(),
+                 f_a.vars().end(),
+                 f_b.vars().begin(),
+                 f_b.vars().end(),
+                 std::back_inserter(product_vars),
+                 pgm::rv_id_comparison());
+
+  check_output_path(path, f_a);
+  check_output_path(path, f_b);
+  chunked_factor output(product_vars, path, max_tile_size);
+  auto a_strides = operand_strides(product_vars, f_a.vars());
+  auto b_strides = operand_strides(product_vars, f_b.vars());
+  auto a_values = f_a.values();
+  auto b_values = f_b.values();
+
+  prefetch_operand(f_a, output, a_strides, 0);
+  prefetch_operand(f_b, output, b_strides, 0);
+  for (std::size_t t = 0; t < output.tile_count(); ++t) {
+    prefetch_operand(f_a, output, a_strides, t + 1);
+    prefetch_operand(f_b, output, b_strides, t + 1);
+
+    scope_cursor cursor(
+        product_vars, {a_strides, b_strides}, t * output.tile_size());
+    auto out = output.tile(t);
+    for (auto& value : out) {
+      value = a_values[cursor.offset(0)] * b_values[cursor.offset(1)];
+      cursor.next();
+    }
+    output.release(t * output.tile_size(), output.tile_size());
+  }
+  return output;
+}
+
+auto chunked_factor_reduction(const chunked_factor& input,
+                              const pgm::rv_evidence& assignments,
+                              const std::string& path,
+                              std::size_t max_tile_size) -> chunked_factor
+{
+  auto input_strides = detail::scope_strides(input.vars());
+  factor::rv_list output_vars;
+  std::size_t base_offset = 0;
+  for (std::size_t i = 0; i < input.vars().size(); ++i) {
+    auto it = assignments.find(input.vars()[i]);
+    if (it == assignments.end()) {
+      output_vars.push_back(input.vars()[i]);
+    } else {
+      if (it->second < 0 || it->second >= it->first.card()) {
+        throw std::runtime_error(
+            "An evidence value is out of range for its variable.");
+      }
+      base_offset += static_cast<std::size_t>(it->second) * input_strides[i];
+    }
+  }
+
+  check_output_path(path, input);
+  chunked_factor output(output_vars, path, max_tile_size);
+  auto strides = operand_strides(output_vars, input.vars());
+  auto in_values = input.values();
+
+  for (std::size_t t = 0; t < output.tile_count(); ++t) {
+    if (t + 1 < output.tile_count()) {
+      scope_cursor ahead(output_vars, {strides}, (t + 1) * output.tile_size());
+      input.prefetch(base_offset + ahead.offset(0),
+                     ahead.trailing_extent(0, output.tile_axes()) + 1);
+    }
+    scope_cursor cursor(output_vars, {strides}, t * output.tile_size());
+    auto out = output.tile(t);
+    for (auto& value : out) {
+      value = in_values[base_offset + cursor.offset(0)];
+      cursor.next();
+    }
+    output.release(t * output.tile_size(), output.tile_size());
+  }
+  return output;
+}
+
+auto chunked_factor_marginalization(const chunked_factor& input,
+                                    const std::vector<pgm::rv>& summation_rvs,
+                                    const std::string& path,
+                                    std::size_t max_tile_size)
+    -> chunked_factor
+{
+  factor::rv_list output_vars;
+  factor::rv_list summed_vars;
+  for (auto v : input.vars()) {
+    auto summed = std::find(summation_rvs.begin(), summation_rvs.end(), v)
+        != summation_rvs.end();
+    (summed ? summed_vars : output_vars).push_back(v);
+  }
+
+  check_output_path(path, input);
+  chunked_factor output(output_vars, path, max_tile_size);
+
+  // Gather into one output tile at a time: iterating over the output
+  // variables followed by the summed ones visits, for each output cell,
+  // the input cells that sum into it.
+  auto iter_vars = output_vars;
+  iter_vars.insert(iter_vars.end(), summed_vars.begin(), summed_vars.end());
+  auto strides = operand_strides(iter_vars, input.vars());
+  auto summed_size = detail::scope_size(summed_vars);
+  auto span_axes = output.tile_axes() + summed_vars.size();
+  auto in_values = input.values();
+
+  auto prefetch_input = [&](std::size_t t)
+  {
+    if (t < output.tile_count()) {
+      scope_cursor ahead(
+          iter_vars, {strides}, t * output.tile_size() * summed_size);
+      input.prefetch(ahead.offset(0), ahead.trailing_extent(0, span_axes) + 1);
+    }
+  };
+  prefetch_input(0);
+  for (std::size_t t = 0; t < output.tile_count(); ++t) {
+    prefetch_input(t + 1);
+    scope_cursor cursor(
+        iter_vars, {strides}, t * output.tile_size() * summed_size);
+    for (auto& value : output.tile(t)) {
+      for (std::size_t k = 0; k < summed_size; ++k) {
+        value += in_values[cursor.offset(0)];
+        cursor.next();
+      }
+    }
+    output.release(t * output.tile_size(), output.tile_size());
+  }
+  return output;
+}
+
+}  // namespace pgm
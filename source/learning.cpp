@@ -0,0 +1,507 @@
+// learning.cpp
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <filesystem>
+#include <limits>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "pgm/learning.hpp"
+
+#include "parallel.hpp"
+#include "pgm/factor.hpp"
+#include "pgm/rv.hpp"
+#include "scope_layout.hpp"
+
+namespace pgm
+{
+
+namespace
+{
+
+// Where each variable of a family scope lives, both in a data row and in
+// the family's row-major count table.
+struct family_layout
+{
+  factor::rv_list scope;
+  std::vector<std::size_t> columns;
+  std::vector<std::size_t> strides;
+  std::size_t size;
+  std::vector<assignment_table::value_type> cards;
+};
+
+auto make_layout(const family& fam, const assignment_table& data)
+    -> family_layout
+{
+  auto scope = fam.scope();
+  family_layout layout {
+      scope, {}, detail::scope_strides(scope), detail::scope_size(scope), {}};
+  for (auto v : layout.scope) {
+    layout.columns.push_back(data.column_of(v));
+    layout.cards.push_back(v.card());
+  }
+  return layout;
+}
+
+auto make_layouts(const std::vector<family>& families,
+                  const assignment_table& data) -> std::vector<family_layout>
+{
+  std::vector<family_layout> layouts;
+  layouts.reserve(families.size());
+  for (const auto& fam : families) {
+    layouts.push_back(make_layout(fam, data));
+  }
+  return layouts;
+}
+
+using count_tables = std::vector<std::vector<factor::value_type>>;
+
+auto empty_counts(const std::vector<family_layout>& layouts) -> count_tables
+{
+  count_tables counts;
+  counts.reserve(layouts.size());
+  for (const auto& layout : layouts) {
+    counts.emplace_back(layout.size, 0.);
+  }
+  return counts;
+}
+
+// Sums per-thread count tables into the first one.
+auto merge_counts(std::vector<count_tables>& per_thread) -> count_tables
+{
+  auto& total = per_thread.front();
+  for (std::size_t t = 1; t < per_thread.size(); ++t) {
+    for (std::size_t f = 0; f < total.size(); ++f) {
+      std::transform(total[f].begin(),
+                     total[f].end(),
+                     per_thread[t][f].begin(),
+                     total[f].begin(),
+                     std::plus<>());
+    }
+  }
+  return std::move(total);
+}
+
+// Data values index count tables directly, so one that is too large for
+// its variable would write outside the table.
+void check_value(assignment_table::value_type value,
+                 assignment_table::value_type card)
+{
+  if (value >= card) {
+    throw std::runtime_error(
+        "An assignment value is out of range for its column's variable.");
+  }
+}
+
+auto is_partial(std::span<const assignment_table::value_type> row) -> bool
+{
+  return std::any_of(row.begin(), row.end(), [](auto x) { return x < 0; });
+}
+
+// The counting kernel.  If complete_rows_only is set, rows with any missing
+// value are skipped entirely; otherwise only the families whose scope has a
+// missing value skip the row.
+auto accumulate_counts(const assignment_table& data,
+                       const std::vector<family_layout>& layouts,
+                       bool complete_rows_only,
+                       unsigned n_threads) -> count_tables
+{
+  n_threads = detail::resolve_thread_count(n_threads);
+  std::vector<count_tables> per_thread(n_threads);
+
+  detail::parallel_for_ranges(
+      data.rows(),
+      n_threads,
+      [&](unsigned t, std::size_t first, std::size_t last)
+      {
+        auto counts = empty_counts(layouts);
+        for (auto i = first; i < last; ++i) {
+          auto row = data.row(i);
+          if (complete_rows_only && is_partial(row)) {
+            continue;
+          }
+          for (std::size_t f = 0; f < layouts.size(); ++f) {
+            const auto& layout = layouts[f];
+            std::size_t index = 0;
+            bool observed = true;
+            for (std::size_t k = 0; k < layout.columns.size(); ++k) {
+              auto value = row[layout.columns[k]];
+              check_value(value, layout.cards[k]);
+              observed = observed && value >= 0;
+              index += static_cast<std::size_t>(value) * layout.strides[k];
+            }
+            if (observed) {
+              counts[f][index] += 1.;
+            }
+          }
+        }
+        per_thread[t] = std::move(counts);
+      });
+
+  return merge_counts(per_thread);
+}
+
+auto to_factors(const std::vector<family_layout>& layouts,
+                const count_tables& counts) -> std::vector<factor>
+{
+  std::vector<factor> result;
+  result.reserve(layouts.size());
+  for (std::size_t f = 0; f < layouts.size(); ++f) {
+    result.push_back(detail::make_factor(layouts[f].scope, counts[f]));
+  }
+  return result;
+}
+
+auto max_abs_difference(const std::vector<factor>& a,
+                        const std::vector<factor>& b) -> double
+{
+  double result = 0.;
+  for (std::size_t f = 0; f < a.size(); ++f) {
+    auto it_b = b[f].data().begin();
+    for (auto x : a[f].data()) {
+      result = std::max(result, std::abs(x - *it_b));
+      ++it_b;
+    }
+  }
+  return result;
+}
+
+using row_values = std::vector<assignment_table::value_type>;
+
+// A distinct partially observed row and the number of times it occurs.
+using observation_pattern = std::pair<row_values, double>;
+
+struct row_hash
+{
+  auto operator()(const row_values& row) const -> std::size_t
+  {
+    std::size_t h = row.size();
+    for (auto x : row) {
+      h ^= static_cast<std::uint32_t>(x) + 0x9e3779b97f4a7c15 + (h << 6)
+          + (h >> 2);
+    }
+    return h;
+  }
+};
+
+using pattern_map = std::unordered_map<row_values, double, row_hash>;
+
+// Groups the partially observed rows by value.  Each thread deduplicates
+// its own range of rows and the maps are merged, then sorted so that the
+// E-step visits patterns in the same order for any thread count.  Returns
+// nothing once there are more than max_patterns distinct patterns.
+auto partial_patterns(const assignment_table& data,
+                      std::size_t max_patterns,
+                      unsigned n_threads)
+    -> std::optional<std::vector<observation_pattern>>
+{
+  std::vector<pattern_map> per_thread(n_threads);
+  std::atomic<bool> overflow {false};
+  detail::parallel_for_ranges(
+      data.rows(),
+      n_threads,
+      [&](unsigned t, std::size_t first, std::size_t last)
+      {
+        auto& patterns = per_thread[t];
+        for (auto i = first; i < last; ++i) {
+          if (overflow.load(std::memory_order_relaxed)) {
+            return;
+          }
+          auto row = data.row(i);
+          if (is_partial(row)) {
+            patterns[{row.begin(), row.end()}] += 1.;
+            if (patterns.size() > max_patterns) {
+              overflow = true;
+            }
+          }
+        }
+      });
+  if (overflow) {
+    return std::nullopt;
+  }
+
+  auto& merged = per_thread.front();
+  for (std::size_t t = 1; t < per_thread.size(); ++t) {
+    for (auto& [row, count] : per_thread[t]) {
+      merged[row] += count;
+    }
+    pattern_map().swap(per_thread[t]);
+    if (merged.size() > max_patterns) {
+      return std::nullopt;
+    }
+  }
+  std::vector<observation_pattern> result(merged.begin(), merged.end());
+  std::sort(result.begin(), result.end());
+  return result;
+}
+
+// E-step for one partially observed row that occurs weight times: adds
+// weight times the posterior over each family's missing variables into that
+// family's count table.  Returns the log probability of the observed values.
+auto expected_counts(std::span<const assignment_table::value_type> row,
+                     double weight,
+                     const assignment_table& data,
+                     const std::vector<family_layout>& layouts,
+                     const std::vector<factor>& cpds,
+                     count_tables& counts) -> double
+{
+  pgm::rv_evidence evidence;
+  for (std::size_t c = 0; c < row.size(); ++c) {
+    if (row[c] >= 0) {
+      check_value(row[c], data.columns()[c].card());
+      evidence[data.columns()[c]] = row[c];
+    }
+  }
+
+  auto joint = factor_reduction(cpds.front(), evidence);
+  for (std::size_t f = 1; f < cpds.size(); ++f) {
+    joint = factor_product(joint, factor_reduction(cpds[f], evidence));
+  }
+  factor::value_type likelihood = 0.;
+  for (auto x : joint.data()) {
+    likelihood += x;
+  }
+  if (!(likelihood > 0.)) {
+    return -std::numeric_limits<double>::infinity();
+  }
+  auto posterior = factor_normalization(joint);
+
+  for (std::size_t f = 0; f < layouts.size(); ++f) {
+    const auto& layout = layouts[f];
+    std::size_t base = 0;
+    std::vector<std::size_t> missing_strides;
+    factor::rv_list missing;
+    for (std::size_t k = 0; k < layout.scope.size(); ++k) {
+      auto value = row[layout.columns[k]];
+      if (value >= 0) {
+        base += static_cast<std::size_t>(value) * layout.strides[k];
+      } else {
+        missing.push_back(layout.scope[k]);
+        missing_strides.push_back(layout.strides[k]);
+      }
+    }
+    factor::rv_list summed;
+    std::set_difference(posterior.vars().begin(),
+                        posterior.vars().end(),
+                        missing.begin(),
+                        missing.end(),
+                        std::back_inserter(summed),
+                        pgm::rv_id_comparison());
+    auto marginal = factor_marginalization(posterior, summed);
+
+    std::size_t m = 0;
+    for (auto p : marginal.data()) {
+      auto rest = m++;
+      auto index = base;
+      for (auto k = missing.size(); k-- > 0;) {
+        auto card = static_cast<std::size_t>(missing[k].card());
+        index += (rest % card) * missing_strides[k];
+        rest /= card;
+      }
+      counts[f][index] += weight * p;
+    }
+  }
+  return weight * std::log(likelihood);
+}
+
+}  // namespace
+
+
+auto family::scope() const -> factor::rv_list
+{
+  if (std::find(parents.begin(), parents.end(), child) != parents.end()) {
+    throw std::runtime_error("A family's child cannot also be its parent.");
+  }
+  factor::rv_list result(parents);
+  result.push_back(child);
+  std::sort(result.begin(), result.end(), pgm::rv_id_comparison());
+  return result;
+}
+
+assignment_table::assignment_table(std::span<const value_type> values,
+                                   const factor::rv_list& columns)
+    : m_values(values)
+    , m_columns(columns)
+    , m_rows(columns.empty() ? 0 : values.size() / columns.size())
+{
+  if (columns.empty() || values.size() % columns.size() != 0) {
+    throw std::runtime_error(
+        "Assignment data size is not a multiple of the number of columns.");
+  }
+}
+
+auto assignment_table::column_of(pgm::rv v) const -> std::size_t
+{
+  auto it = std::find(m_columns.begin(), m_columns.end(), v);
+  if (it == m_columns.end()) {
+    throw std::runtime_error("Random variable is not a column of the data.");
+  }
+  return it - m_columns.begin();
+}
+
+assignment_file::assignment_file(const factor::rv_list& columns,
+                                 std::size_t rows,
+                                 mapped_file file)
+    : m_columns(columns)
+    , m_rows(rows)
+    , m_file(std::move(file))
+{
+}
+
+auto assignment_file::open(const std::string& path,
+                           const factor::rv_list& columns) -> assignment_file
+{
+  auto row_bytes = columns.size() * sizeof(assignment_table::value_type);
+  auto bytes = std::filesystem::file_size(path);
+  if (row_bytes == 0 || bytes % row_bytes != 0) {
+    throw std::runtime_error("Size of assignment file '" + path
+                             + "' is not a whole number of rows.");
+  }
+  return assignment_file(
+      columns, bytes / row_bytes, mapped_file(path, bytes, false));
+}
+
+auto assignment_file::table() const -> assignment_table
+{
+  return assignment_table(
+      {static_cast<const assignment_table::value_type*>(m_file.addr()),
+       m_rows * m_columns.size()},
+      m_columns);
+}
+
+auto count_families(const assignment_table& data,
+                    const std::vector<family>& families,
+                    unsigned n_threads) -> std::vector<factor>
+{
+  auto layouts = make_layouts(families, data);
+  return to_factors(layouts,
+                    accumulate_counts(data, layouts, false, n_threads));
+}
+
+auto conditional_normalization(const factor& counts,
+                               pgm::rv child,
+                               factor::value_type pseudocount) -> factor
+{
+  factor smoothed(counts.vars(), counts.data() + pseudocount);
+  auto cpd = smoothed.vars().size() == 1
+      ? factor_normalization(smoothed)
+      : factor_division(smoothed, factor_marginalization(smoothed, child));
+
+  // Unobserved parent configurations, or a child that was never observed
+  // at all, divide 0 by 0.
+  auto data = cpd.data();
+  std::replace_if(data.begin(),
+                  data.end(),
+                  [](auto x) { return std::isnan(x); },
+                  1. / child.card());
+  return factor(cpd.vars(), data);
+}
+
+auto fit_cpds(const assignment_table& data,
+              const std::vector<family>& families,
+              factor::value_type pseudocount,
+              unsigned n_threads) -> std::vector<factor>
+{
+  auto counts = count_families(data, families, n_threads);
+  std::vector<factor> cpds;
+  cpds.reserve(families.size());
+  for (std::size_t f = 0; f < families.size(); ++f) {
+    cpds.push_back(
+        conditional_normalization(counts[f], families[f].child, pseudocount));
+  }
+  return cpds;
+}
+
+auto fit_cpds_em(const assignment_table& data,
+                 const std::vector<family>& families,
+                 const std::vector<factor>& initial_cpds,
+                 const em_options& options) -> em_result
+{
+  if (families.empty()) {
+    throw std::runtime_error("EM needs at least one family.");
+  }
+  auto n_threads = detail::resolve_thread_count(options.n_threads);
+  auto layouts = make_layouts(families, data);
+
+  // Fully observed rows contribute the same counts in every iteration.
+  auto complete_counts = accumulate_counts(data, layouts, true, n_threads);
+  auto patterns = partial_patterns(data, options.max_patterns, n_threads);
+
+  if (!initial_cpds.empty()) {
+    if (initial_cpds.size() != families.size()) {
+      throw std::runtime_error("Each family needs exactly one CPD.");
+    }
+    for (std::size_t f = 0; f < families.size(); ++f) {
+      if (!(initial_cpds[f].vars() == layouts[f].scope)) {
+        throw std::runtime_error("A CPD's scope does not match its family.");
+      }
+    }
+  }
+  em_result result {initial_cpds, 0., 0, false};
+  if (result.cpds.empty()) {
+    result.cpds = fit_cpds(data, families, options.pseudocount, n_threads);
+  }
+
+  while (result.iterations < options.max_iterations && !result.converged) {
+    // E-step
+    std::vector<count_tables> per_thread(n_threads);
+    std::vector<double> log_likelihoods(n_threads, 0.);
+    detail::parallel_for_ranges(
+        patterns ? patterns->size() : data.rows(),
+        n_threads,
+        [&](unsigned t, std::size_t first, std::size_t last)
+        {
+          auto counts = empty_counts(layouts);
+          for (auto i = first; i < last; ++i) {
+            if (patterns) {
+              const auto& [row, weight] = (*patterns)[i];
+              log_likelihoods[t] += expected_counts(
+                  row, weight, data, layouts, result.cpds, counts);
+            } else if (is_partial(data.row(i))) {
+              log_likelihoods[t] += expected_counts(
+                  data.row(i), 1., data, layouts, result.cpds, counts);
+            }
+          }
+          per_thread[t] = std::move(counts);
+        });
+    auto counts = merge_counts(per_thread);
+
+    result.log_likelihood = 0.;
+    for (auto ll : log_likelihoods) {
+      result.log_likelihood += ll;
+    }
+    for (std::size_t f = 0; f < layouts.size(); ++f) {
+      const auto& cpd = result.cpds[f].data();
+      auto it_cpd = cpd.begin();
+      for (std::size_t i = 0; i < layouts[f].size; ++i, ++it_cpd) {
+        if (complete_counts[f][i] > 0.) {
+          result.log_likelihood += complete_counts[f][i] * std::log(*it_cpd);
+        }
+        counts[f][i] += complete_counts[f][i];
+      }
+    }
+
+    // M-step
+    std::vector<factor> cpds;
+    cpds.reserve(families.size());
+    for (std::size_t f = 0; f < families.size(); ++f) {
+      cpds.push_back(conditional_normalization(
+          detail::make_factor(layouts[f].scope, counts[f]),
+          families[f].child,
+          options.pseudocount));
+    }
+    result.converged =
+        max_abs_difference(cpds, result.cpds) < options.tolerance;
+    result.cpds = std::move(cpds);
+    ++result.iterations;
+  }
+  return result;
+}
+
+}  // namespace pgm
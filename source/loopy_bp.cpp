@@ -0,0 +1,283 @@
+// loopy_bp.cpp
+#include <algorithm>
+#include <cmath>
+#include <queue>
+#include <stdexcept>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "pgm/loopy_bp.hpp"
+
+#include "pgm/factor.hpp"
+#include "pgm/rv.hpp"
+#include "scope_layout.hpp"
+
+namespace pgm
+{
+
+namespace
+{
+
+auto uniform_factor(const factor::rv_list& vars) -> factor
+{
+  std::vector<std::size_t> shape;
+  for (auto v : vars) {
+    shape.push_back(static_cast<std::size_t>(v.card()));
+  }
+  auto data = factor::data_array::from_shape(shape);
+  std::fill(data.begin(), data.end(), 1.);
+  return factor_normalization(factor(vars, data));
+}
+
+// For each entry of a table over scope, the entry of the table over sepset
+// that it sums into.  Both lists are in ascending id order.
+auto sepset_index(const factor::rv_list& scope, const factor::rv_list& sepset)
+    -> std::vector<std::size_t>
+{
+  auto sepset_strides = detail::scope_strides(sepset);
+  std::vector<std::size_t> strides(scope.size(), 0);
+  for (std::size_t k = 0; k < sepset.size(); ++k) {
+    auto it = std::find(scope.begin(), scope.end(), sepset[k]);
+    strides[it - scope.begin()] = sepset_strides[k];
+  }
+
+  std::vector<std::size_t> index(detail::scope_size(scope));
+  std::vector<std::size_t> digits(scope.size(), 0);
+  std::size_t offset = 0;
+  for (auto& entry : index) {
+    entry = offset;
+    for (auto k = scope.size(); k-- > 0;) {
+      auto card = static_cast<std::size_t>(scope[k].card());
+      offset += strides[k];
+      if (++digits[k] < card) {
+        break;
+      }
+      offset -= card * strides[k];
+      digits[k] = 0;
+    }
+  }
+  return index;
+}
+
+void normalize(std::vector<factor::value_type>& values)
+{
+  factor::value_type total = 0.;
+  for (auto x : values) {
+    total += x;
+  }
+  if (total > 0.) {
+    for (auto& x : values) {
+      x /= total;
+    }
+  }
+}
+
+auto residual(const std::vector<factor::value_type>& a,
+              const std::vector<factor::value_type>& b) -> double
+{
+  double result = 0.;
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    result = std::max(result, std::abs(a[i] - b[i]));
+  }
+  return result;
+}
+
+}  // namespace
+
+
+auto cluster_graph::add_cluster(const factor& potential) -> std::size_t
+{
+  m_potentials.push_back(potential);
+  m_potential_values.emplace_back(potential.data().begin(),
+                                  potential.data().end());
+  m_beliefs.push_back(m_potential_values.back());
+  m_incoming.emplace_back();
+  m_outgoing.emplace_back();
+  return m_potentials.size() - 1;
+}
+
+void cluster_graph::add_edge(std::size_t a,
+                             std::size_t b,
+                             const factor::rv_list& sepset)
+{
+  if (a >= m_potentials.size() || b >= m_potentials.size() || a == b) {
+    throw std::runtime_error("An edge must join two distinct clusters.");
+  }
+  auto sorted_sepset = sepset;
+  std::sort(sorted_sepset.begin(), sorted_sepset.end(), pgm::rv_id_comparison());
+  for (auto v : sorted_sepset) {
+    if (!m_potentials[a].scope_contains(v) || !m_potentials[b].scope_contains(v))
+    {
+      throw std::runtime_error(
+          "A sepset variable is missing from one of the edge's clusters.");
+    }
+  }
+  auto sepset_size = detail::scope_size(sorted_sepset);
+  for (auto [from, to] : {std::pair {a, b}, std::pair {b, a}}) {
+    m_outgoing[from].push_back(m_edges.size());
+    m_incoming[to].push_back(m_edges.size());
+    m_edges.push_back({from,
+                       to,
+                       sorted_sepset,
+                       sepset_index(m_potentials[from].vars(), sorted_sepset)});
+    m_messages.emplace_back(sepset_size, 1. / static_cast<double>(sepset_size));
+    m_pending.push_back(m_messages.back());
+  }
+}
+
+auto cluster_graph::bethe(const std::vector<factor>& factors) -> cluster_graph
+{
+  cluster_graph graph;
+  factor::rv_list vars;
+  for (const auto& f : factors) {
+    graph.add_cluster(f);
+    vars.insert(vars.end(), f.vars().begin(), f.vars().end());
+  }
+  std::sort(vars.begin(), vars.end(), pgm::rv_id_comparison());
+  vars.erase(std::unique(vars.begin(), vars.end()), vars.end());
+
+  for (auto v : vars) {
+    auto var_cluster = graph.add_cluster(uniform_factor({v}));
+    for (std::size_t f = 0; f < factors.size(); ++f) {
+      if (factors[f].scope_contains(v)) {
+        graph.add_edge(f, var_cluster, {v});
+      }
+    }
+  }
+  return graph;
+}
+
+// The potential of a cluster times every message into it.
+void cluster_graph::compute_belief(std::size_t cluster, table& out) const
+{
+  out = m_potential_values[cluster];
+  for (auto in : m_incoming[cluster]) {
+    const auto& index = m_edges[in ^ 1].sepset_index;
+    const auto& message = m_messages[in];
+    for (std::size_t x = 0; x < out.size(); ++x) {
+      out[x] *= message[index[x]];
+    }
+  }
+}
+
+// The message along edge i -> j: the belief of i without the message from
+// j, summed down to the sepset.  A belief entry can only be 0 where that
+// message is 0, and such entries contribute 0.
+void cluster_graph::compute_message(std::size_t edge)
+{
+  const auto& e = m_edges[edge];
+  const auto& belief = m_beliefs[e.from];
+  const auto& incoming = m_messages[edge ^ 1];
+  auto& out = m_pending[edge];
+  std::fill(out.begin(), out.end(), 0.);
+  for (std::size_t x = 0; x < belief.size(); ++x) {
+    auto s = e.sepset_index[x];
+    if (incoming[s] > 0.) {
+      out[s] += belief[x] / incoming[s];
+    }
+  }
+  normalize(out);
+}
+
+auto cluster_graph::run(const bp_options& options) -> bp_result
+{
+  // Max-heap of (residual, edge, version).  Recomputing an edge's pending
+  // message bumps its version, which invalidates older queue entries.
+  using entry = std::tuple<double, std::size_t, std::size_t>;
+  std::priority_queue<entry> queue;
+  std::vector<std::size_t> version(m_edges.size(), 0);
+
+  auto refresh = [&](std::size_t edge)
+  {
+    compute_message(edge);
+    queue.emplace(residual(m_pending[edge], m_messages[edge]),
+                  edge,
+                  ++version[edge]);
+  };
+
+  for (std::size_t c = 0; c < m_potentials.size(); ++c) {
+    compute_belief(c, m_beliefs[c]);
+  }
+  for (std::size_t edge = 0; edge < m_edges.size(); ++edge) {
+    refresh(edge);
+  }
+
+  bp_result result {0, 0., false};
+  while (!queue.empty()) {
+    auto [r, edge, v] = queue.top();
+    if (v != version[edge]) {
+      queue.pop();
+      continue;
+    }
+    result.max_residual = r;
+    if (r < options.tolerance) {
+      result.converged = true;
+      break;
+    }
+    if (result.updates >= options.max_updates) {
+      break;
+    }
+    queue.pop();
+
+    auto& message = m_messages[edge];
+    const auto& pending = m_pending[edge];
+    if (options.damping > 0.) {
+      for (std::size_t s = 0; s < message.size(); ++s) {
+        message[s] =
+            (1. - options.damping) * pending[s] + options.damping * message[s];
+      }
+      // The pending message is unchanged, so its residual only shrinks.
+      queue.emplace(residual(pending, message), edge, ++version[edge]);
+    } else {
+      std::copy(pending.begin(), pending.end(), message.begin());
+    }
+    ++result.updates;
+
+    const auto& e = m_edges[edge];
+    compute_belief(e.to, m_beliefs[e.to]);
+    for (auto out : m_outgoing[e.to]) {
+      if (out != (edge ^ 1)) {
+        refresh(out);
+      }
+    }
+  }
+  if (queue.empty()) {
+    result.max_residual = 0.;
+    result.converged = true;
+  }
+  return result;
+}
+
+auto cluster_graph::belief(std::size_t cluster) const -> factor
+{
+  table values;
+  compute_belief(cluster, values);
+  normalize(values);
+  return detail::make_factor(m_potentials.at(cluster).vars(), values);
+}
+
+auto cluster_graph::marginal(pgm::rv v) const -> factor
+{
+  auto best = m_potentials.size();
+  for (std::size_t c = 0; c < m_potentials.size(); ++c) {
+    if (m_potentials[c].scope_contains(v)
+        && (best == m_potentials.size()
+            || m_potentials[c].vars().size() < m_potentials[best].vars().size()))
+    {
+      best = c;
+    }
+  }
+  if (best == m_potentials.size()) {
+    throw std::runtime_error("No cluster contains the random variable.");
+  }
+  auto b = belief(best);
+  factor::rv_list summed;
+  std::copy_if(b.vars().begin(),
+               b.vars().end(),
+               std::back_inserter(summed),
+               [v](auto u) { return !(u == v); });
+  return factor_marginalization(b, summed);
+}
+
+}  // namespace pgm
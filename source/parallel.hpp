@@ -0,0 +1,57 @@
+#ifndef PGM_PARALLEL_HPP
+#define PGM_PARALLEL_HPP
+// parallel.hpp
+// Internal threading helpers shared by the library's translation units.
+
+#include <cstddef>
+#include <exception>
+#include <thread>
+#include <vector>
+
+namespace pgm::detail
+{
+
+// Maps a requested thread count of 0 to the hardware concurrency.
+inline auto resolve_thread_count(unsigned n_threads) -> unsigned
+{
+  if (n_threads == 0) {
+    n_threads = std::thread::hardware_concurrency();
+  }
+  return n_threads == 0 ? 1 : n_threads;
+}
+
+// Splits [0, n_items) into n_threads contiguous ranges and calls
+// fn(thread_index, first, last) for each range on its own thread.
+// The calling thread runs the last range itself.  The first exception
+// thrown by any range is rethrown after all threads have joined.
+template<class Function>
+void parallel_for_ranges(std::size_t n_items, unsigned n_threads, Function fn)
+{
+  std::vector<std::thread> threads;
+  std::vector<std::exception_ptr> errors(n_threads);
+  auto run = [&](unsigned t)
+  {
+    try {
+      fn(t, n_items * t / n_threads, n_items * (t + 1) / n_threads);
+    } catch (...) {
+      errors[t] = std::current_exception();
+    }
+  };
+  threads.reserve(n_threads - 1);
+  for (unsigned t = 0; t + 1 < n_threads; ++t) {
+    threads.emplace_back(run, t);
+  }
+  run(n_threads - 1);
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  for (auto& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
+}
+
+}  // namespace pgm::detail
+
+#endif  // PGM_PARALLEL_HPP
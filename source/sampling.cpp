@@ -0,0 +1,552 @@
+// sampling.cpp
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <stdexcept>
+#include <vector>
+
+#include "pgm/sampling.hpp"
+
+#include "parallel.hpp"
+#include "pgm/factor.hpp"
+#include "pgm/learning.hpp"
+#include "pgm/rv.hpp"
+#include "pgm/structured_cpd.hpp"
+#include "scope_layout.hpp"
+
+namespace pgm
+{
+
+namespace
+{
+
+// SplitMix64 finalizer: a bijective 64-bit mixing function.
+auto mix64(std::uint64_t z) -> std::uint64_t
+{
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// Counter-based generator: the draw is a pure function of (seed, stream,
+// counter), so any thread can produce any sample's randomness without
+// sharing or advancing generator state.
+auto counter_uniform(std::uint64_t seed,
+                     std::uint64_t stream,
+                     std::uint64_t counter) -> double
+{
+  auto key = mix64(seed + 0x9e3779b97f4a7c15ULL * (stream + 1));
+  auto bits = mix64(key ^ mix64(counter + 0x632be59bd9b4e019ULL));
+  return static_cast<double>(bits >> 11) * 0x1.0p-53;
+}
+
+// O(1) draw from one row of a node's alias tables, given u in [0, 1).
+template<class Node>
+auto alias_draw(const Node& nd, std::size_t row, double u) -> std::uint32_t
+{
+  auto card = static_cast<std::size_t>(nd.var.card());
+  auto scaled = u * static_cast<double>(card);
+  auto x = std::min(static_cast<std::size_t>(scaled), card - 1);
+  auto cell = row * card + x;
+  return scaled - static_cast<double>(x) < nd.alias_prob[cell]
+      ? static_cast<std::uint32_t>(x)
+      : nd.alias[cell];
+}
+
+// P(var <= y | parents) of a noisy-MAX node, where parent_value(i) is the
+// value of its i-th parent.
+template<class Node, class ParentValue>
+auto noisy_max_cdf(const Node& nd, ParentValue parent_value, std::size_t y)
+    -> double
+{
+  auto card = static_cast<std::size_t>(nd.var.card());
+  auto p = nd.leak_cdf[y];
+  for (std::size_t i = 0; i < nd.level_cdfs.size(); ++i) {
+    p *= nd.level_cdfs[i][static_cast<std::size_t>(parent_value(i)) * card + y];
+  }
+  return p;
+}
+
+// P(var = x | parents) for a node of either kind.
+template<class Node, class ParentValue>
+auto cpd_entry(const Node& nd, ParentValue parent_value, std::size_t x)
+    -> double
+{
+  if (nd.leak_cdf.empty()) {
+    std::size_t row = 0;
+    for (std::size_t i = 0; i < nd.parents.size(); ++i) {
+      row += static_cast<std::size_t>(parent_value(i)) * nd.row_strides[i];
+    }
+    return nd.table[row * static_cast<std::size_t>(nd.var.card()) + x];
+  }
+  auto upper = noisy_max_cdf(nd, parent_value, x);
+  return x == 0 ? upper : upper - noisy_max_cdf(nd, parent_value, x - 1);
+}
+
+// Draws a node's value given its parents and u in [0, 1): O(1) from the
+// alias table of a dense CPD, or by inverting the CDF of a noisy-MAX CPD in
+// O(card * parents).
+template<class Node, class ParentValue>
+auto cpd_draw(const Node& nd, ParentValue parent_value, double u)
+    -> std::uint32_t
+{
+  auto card = static_cast<std::size_t>(nd.var.card());
+  if (nd.leak_cdf.empty()) {
+    std::size_t row = 0;
+    for (std::size_t i = 0; i < nd.parents.size(); ++i) {
+      row += static_cast<std::size_t>(parent_value(i)) * nd.row_strides[i];
+    }
+    return alias_draw(nd, row, u);
+  }
+  std::size_t y = 0;
+  while (y + 1 < card && !(u < noisy_max_cdf(nd, parent_value, y))) {
+    ++y;
+  }
+  return static_cast<std::uint32_t>(y);
+}
+
+auto expired(const sampling_options& options) -> bool
+{
+  return options.deadline
+      && std::chrono::steady_clock::now() >= *options.deadline;
+}
+
+}  // namespace
+
+
+network_sampler::network_sampler(
+    const std::vector<family>& dense_families,
+    const std::vector<factor>& cpds,
+    const std::vector<noisy_max_cpd>& noisy_max_cpds)
+{
+  if (dense_families.size() != cpds.size()) {
+    throw std::runtime_error("Each family needs exactly one CPD.");
+  }
+  // Families past the dense ones belong to the noisy-MAX CPDs.
+  auto families = dense_families;
+  for (const auto& cpd : noisy_max_cpds) {
+    families.push_back({cpd.child(), cpd.parents()});
+  }
+  std::map<pgm::rv, std::size_t, pgm::rv_id_comparison> family_of;
+  for (std::size_t f = 0; f < families.size(); ++f) {
+    if (!family_of.emplace(families[f].child, f).second) {
+      throw std::runtime_error("A variable is the child of two families.");
+    }
+  }
+
+  // Kahn's algorithm: emit a family once all of its parents are emitted.
+  std::vector<std::size_t> pending(families.size());
+  std::vector<std::vector<std::size_t>> dependents(families.size());
+  for (std::size_t f = 0; f < families.size(); ++f) {
+    for (auto p : families[f].parents) {
+      auto it = family_of.find(p);
+      if (it == family_of.end()) {
+        throw std::runtime_error("A parent variable has no family.");
+      }
+      dependents[it->second].push_back(f);
+      ++pending[f];
+    }
+  }
+  std::vector<std::size_t> order;
+  for (std::size_t f = 0; f < families.size(); ++f) {
+    if (pending[f] == 0) {
+      order.push_back(f);
+    }
+  }
+  for (std::size_t i = 0; i < order.size(); ++i) {
+    for (auto d : dependents[order[i]]) {
+      if (--pending[d] == 0) {
+        order.push_back(d);
+      }
+    }
+  }
+  if (order.size() != families.size()) {
+    throw std::runtime_error("The families do not form a directed acyclic graph.");
+  }
+
+  for (auto f : order) {
+    m_nodes.push_back({families[f].child, {}, {}, {}, {}, {}, {}, {}, {}});
+  }
+  for (std::size_t n = 0; n < m_nodes.size(); ++n) {
+    const auto& fam = families[order[n]];
+    auto& nd = m_nodes[n];
+    for (auto p : fam.parents) {
+      nd.parents.push_back(node_of(p));
+      m_nodes[nd.parents.back()].children.push_back(n);
+    }
+    auto card = static_cast<std::size_t>(nd.var.card());
+
+    if (order[n] >= dense_families.size()) {
+      const auto& cpd = noisy_max_cpds[order[n] - dense_families.size()];
+      // Cumulative sums within each row of card entries.
+      auto cumulative = [card](const std::vector<factor::value_type>& p)
+      {
+        std::vector<double> c(p.size());
+        for (std::size_t i = 0; i < p.size(); ++i) {
+          c[i] = i % card == 0 ? p[i] : c[i - 1] + p[i];
+        }
+        return c;
+      };
+      nd.leak_cdf = cumulative(cpd.leak());
+      for (const auto& levels : cpd.levels()) {
+        nd.level_cdfs.push_back(cumulative(levels));
+      }
+      continue;
+    }
+
+    const auto& cpd = cpds[order[n]];
+    if (!(cpd.vars() == fam.scope())) {
+      throw std::runtime_error("A CPD's scope does not match its family.");
+    }
+    auto rows = detail::scope_size(fam.parents);
+    nd.row_strides = detail::scope_strides(fam.parents);
+
+    // Re-lay the CPD as [row][child value], where row enumerates the parent
+    // configurations in the family's parent order.
+    const auto& vars = cpd.vars();
+    std::vector<std::size_t> axis_row_stride(vars.size(), 0);
+    std::size_t child_axis = 0;
+    for (std::size_t k = 0; k < vars.size(); ++k) {
+      if (vars[k] == nd.var) {
+        child_axis = k;
+      }
+      for (std::size_t i = 0; i < fam.parents.size(); ++i) {
+        if (vars[k] == fam.parents[i]) {
+          axis_row_stride[k] = nd.row_strides[i];
+        }
+      }
+    }
+    nd.table.resize(rows * card);
+    std::size_t flat = 0;
+    for (auto p : cpd.data()) {
+      auto assignment = detail::unravel(flat++, vars);
+      std::size_t row = 0;
+      for (std::size_t k = 0; k < vars.size(); ++k) {
+        row += static_cast<std::size_t>(assignment[k]) * axis_row_stride[k];
+      }
+      nd.table[row * card + static_cast<std::size_t>(assignment[child_axis])] =
+          p;
+    }
+
+    // Vose's alias method, one table per row.
+    nd.alias_prob.resize(rows * card);
+    nd.alias.resize(rows * card);
+    std::vector<double> scaled(card);
+    std::vector<std::uint32_t> small;
+    std::vector<std::uint32_t> large;
+    for (std::size_t row = 0; row < rows; ++row) {
+      auto* prob = &nd.alias_prob[row * card];
+      auto* alias = &nd.alias[row * card];
+      double total = 0.;
+      for (std::size_t x = 0; x < card; ++x) {
+        total += nd.table[row * card + x];
+      }
+      small.clear();
+      large.clear();
+      for (std::size_t x = 0; x < card; ++x) {
+        scaled[x] = total > 0. ? nd.table[row * card + x] * card / total : 1.;
+        (scaled[x] < 1. ? small : large).push_back(static_cast<std::uint32_t>(x));
+      }
+      while (!small.empty() && !large.empty()) {
+        auto s = small.back();
+        small.pop_back();
+        auto l = large.back();
+        prob[s] = scaled[s];
+        alias[s] = l;
+        scaled[l] -= 1. - scaled[s];
+        if (scaled[l] < 1.) {
+          large.pop_back();
+          small.push_back(l);
+        }
+      }
+      for (auto x : large) {
+        prob[x] = 1.;
+        alias[x] = x;
+      }
+      for (auto x : small) {  // only left over through rounding
+        prob[x] = 1.;
+        alias[x] = x;
+      }
+    }
+  }
+}
+
+auto network_sampler::node_of(pgm::rv v) const -> std::size_t
+{
+  for (std::size_t n = 0; n < m_nodes.size(); ++n) {
+    if (m_nodes[n].var == v) {
+      return n;
+    }
+  }
+  throw std::runtime_error("Random variable is not part of the network.");
+}
+
+auto network_sampler::clamp_values(const pgm::rv_evidence& evidence) const
+    -> std::vector<int>
+{
+  std::vector<int> clamp(m_nodes.size(), -1);
+  for (const auto& [v, value] : evidence) {
+    if (value < 0 || value >= v.card()) {
+      throw std::runtime_error(
+          "An evidence value is out of range for its variable.");
+    }
+    clamp[node_of(v)] = value;
+  }
+  return clamp;
+}
+
+auto network_sampler::likelihood_weighting(
+    pgm::rv query,
+    const pgm::rv_evidence& evidence,
+    const likelihood_weighting_options& options) const -> sample_estimate
+{
+  auto q = node_of(query);
+  auto q_card = static_cast<std::size_t>(query.card());
+  auto clamp = clamp_values(evidence);
+  auto batch_size = std::max<std::size_t>(options.batch_size, 1);
+  auto n_batches = (options.max_samples + batch_size - 1) / batch_size;
+
+  // Weighted sums for one batch.  Batches are combined in index order at
+  // the end, so the floating-point result does not depend on which thread
+  // drew which batch.
+  struct batch_sums
+  {
+    std::size_t samples = 0;
+    double w = 0.;
+    double w2 = 0.;
+    std::vector<double> w_x;
+    std::vector<double> w2_x;
+  };
+  std::vector<batch_sums> sums(n_batches);
+  std::atomic<std::size_t> next_batch = 0;
+
+  auto n_threads = detail::resolve_thread_count(options.n_threads);
+  detail::parallel_for_ranges(
+      n_threads,
+      n_threads,
+      [&](unsigned, std::size_t, std::size_t)
+      {
+        std::vector<std::vector<std::uint32_t>> values(
+            m_nodes.size(), std::vector<std::uint32_t>(batch_size));
+        std::vector<double> weight(batch_size);
+        std::vector<std::size_t> row(batch_size);
+        // The first batch is always drawn, so there is an estimate to return.
+        while (next_batch == 0 || !expired(options)) {
+          auto k = next_batch++;
+          if (k >= n_batches) {
+            break;
+          }
+          auto first = k * batch_size;
+          auto count = std::min(batch_size, options.max_samples - first);
+          std::fill(weight.begin(), weight.begin() + count, 1.);
+
+          for (std::size_t n = 0; n < m_nodes.size(); ++n) {
+            const auto& nd = m_nodes[n];
+            auto& out = values[n];
+            if (!nd.leak_cdf.empty()) {
+              for (std::size_t b = 0; b < count; ++b) {
+                auto parent_value = [&](std::size_t i)
+                { return values[nd.parents[i]][b]; };
+                if (clamp[n] >= 0) {
+                  auto x = static_cast<std::size_t>(clamp[n]);
+                  weight[b] *= cpd_entry(nd, parent_value, x);
+                  out[b] = static_cast<std::uint32_t>(x);
+                } else {
+                  auto u = counter_uniform(options.seed, first + b, n);
+                  out[b] = cpd_draw(nd, parent_value, u);
+                }
+              }
+              continue;
+            }
+            auto card = static_cast<std::size_t>(nd.var.card());
+            std::fill(row.begin(), row.begin() + count, 0);
+            for (std::size_t i = 0; i < nd.parents.size(); ++i) {
+              const auto& parent_values = values[nd.parents[i]];
+              for (std::size_t b = 0; b < count; ++b) {
+                row[b] += parent_values[b] * nd.row_strides[i];
+              }
+            }
+            if (clamp[n] >= 0) {
+              auto x = static_cast<std::size_t>(clamp[n]);
+              for (std::size_t b = 0; b < count; ++b) {
+                weight[b] *= nd.table[row[b] * card + x];
+                out[b] = static_cast<std::uint32_t>(x);
+              }
+            } else {
+              for (std::size_t b = 0; b < count; ++b) {
+                out[b] = alias_draw(
+                    nd, row[b], counter_uniform(options.seed, first + b, n));
+              }
+            }
+          }
+
+          auto& s = sums[k];
+          s.samples = count;
+          s.w_x.assign(q_card, 0.);
+          s.w2_x.assign(q_card, 0.);
+          for (std::size_t b = 0; b < count; ++b) {
+            auto w = weight[b];
+            s.w += w;
+            s.w2 += w * w;
+            s.w_x[values[q][b]] += w;
+            s.w2_x[values[q][b]] += w * w;
+          }
+        }
+      });
+
+  // Claimed batches always form a prefix, and every claimed batch completes.
+  double w = 0.;
+  double w2 = 0.;
+  std::vector<double> w_x(q_card, 0.);
+  std::vector<double> w2_x(q_card, 0.);
+  std::size_t samples = 0;
+  for (std::size_t k = 0; k < std::min<std::size_t>(next_batch, n_batches); ++k) {
+    samples += sums[k].samples;
+    w += sums[k].w;
+    w2 += sums[k].w2;
+    for (std::size_t x = 0; x < q_card; ++x) {
+      w_x[x] += sums[k].w_x[x];
+      w2_x[x] += sums[k].w2_x[x];
+    }
+  }
+  if (!(w > 0.)) {
+    throw std::runtime_error(
+        "No sample is consistent with the evidence; cannot estimate.");
+  }
+
+  // Self-normalized importance sampling: p = sum(w 1[x]) / sum(w), with the
+  // delta-method variance sum(w^2 (1[x] - p)^2) / sum(w)^2.
+  std::vector<double> estimate(q_card);
+  std::vector<double> variance(q_card);
+  for (std::size_t x = 0; x < q_card; ++x) {
+    auto p = w_x[x] / w;
+    estimate[x] = p;
+    variance[x] = (w2_x[x] * (1. - 2. * p) + p * p * w2) / (w * w);
+  }
+  return {detail::make_factor({query}, estimate),
+          detail::make_factor({query}, variance),
+          samples};
+}
+
+auto network_sampler::gibbs(pgm::rv query,
+                            const pgm::rv_evidence& evidence,
+                            const gibbs_options& options) const
+    -> sample_estimate
+{
+  auto q = node_of(query);
+  auto q_card = static_cast<std::size_t>(query.card());
+  auto n_nodes = m_nodes.size();
+  auto n_chains = std::max<std::size_t>(options.n_chains, 1);
+  auto clamp = clamp_values(evidence);
+
+  // Counter layout per chain: sweep s, node n uses counter s * n_nodes + n.
+  // Sweep 0 is the forward-sampled initial state.
+  std::vector<std::vector<std::uint32_t>> states(
+      n_chains, std::vector<std::uint32_t>(n_nodes));
+  std::vector<std::vector<double>> counts(n_chains,
+                                          std::vector<double>(q_card, 0.));
+  auto n_threads = detail::resolve_thread_count(options.n_threads);
+
+  auto run_sweeps = [&](std::size_t first_sweep, std::size_t last_sweep)
+  {
+    detail::parallel_for_ranges(
+        n_chains,
+        n_threads,
+        [&](unsigned, std::size_t first, std::size_t last)
+        {
+          std::vector<double> weights;
+          for (auto c = first; c < last; ++c) {
+            auto& state = states[c];
+            for (auto s = first_sweep; s < last_sweep; ++s) {
+              for (std::size_t n = 0; n < n_nodes; ++n) {
+                const auto& nd = m_nodes[n];
+                auto card = static_cast<std::size_t>(nd.var.card());
+                auto u = counter_uniform(options.seed, c, s * n_nodes + n);
+                auto in_state = [&state](const node& of)
+                {
+                  return [&state, parents = &of.parents](std::size_t i)
+                  { return state[(*parents)[i]]; };
+                };
+                if (clamp[n] >= 0) {
+                  state[n] = static_cast<std::uint32_t>(clamp[n]);
+                  continue;
+                }
+                if (s == 0) {
+                  state[n] = cpd_draw(nd, in_state(nd), u);
+                  continue;
+                }
+                // P(x | Markov blanket) is proportional to the node's own
+                // CPD entry times each child's CPD entry.
+                weights.assign(card, 0.);
+                double total = 0.;
+                for (std::size_t x = 0; x < card; ++x) {
+                  state[n] = static_cast<std::uint32_t>(x);
+                  auto p = cpd_entry(nd, in_state(nd), x);
+                  for (auto ch : nd.children) {
+                    const auto& cn = m_nodes[ch];
+                    p *= cpd_entry(cn, in_state(cn), state[ch]);
+                  }
+                  weights[x] = p;
+                  total += p;
+                }
+                std::size_t x = 0;
+                auto target = u * total;
+                while (x + 1 < card && target >= weights[x]) {
+                  target -= weights[x];
+                  ++x;
+                }
+                state[n] = static_cast<std::uint32_t>(x);
+              }
+              if (s > options.burn_in) {
+                counts[c][state[q]] += 1.;
+              }
+            }
+          }
+        });
+  };
+
+  auto total_sweeps =
+      1 + options.burn_in + std::max<std::size_t>(options.max_sweeps, 1);
+  auto round = std::max<std::size_t>(options.sweeps_per_round, 1);
+  std::size_t done = 0;
+  do {
+    auto next = std::min(done + round, total_sweeps);
+    run_sweeps(done, next);
+    done = next;
+  } while (done < total_sweeps && !expired(options));
+
+  auto first_kept = 1 + options.burn_in;
+  auto kept = static_cast<double>(done > first_kept ? done - first_kept : 0);
+  if (kept == 0.) {
+    // Stopped during burn-in: use the current state of each chain.
+    for (std::size_t c = 0; c < n_chains; ++c) {
+      counts[c][states[c][q]] += 1.;
+    }
+    kept = 1.;
+  }
+
+  // Chains are independent, so the spread of their means estimates the
+  // variance of the pooled mean.
+  std::vector<double> estimate(q_card, 0.);
+  std::vector<double> variance(q_card, 0.);
+  for (std::size_t x = 0; x < q_card; ++x) {
+    for (std::size_t c = 0; c < n_chains; ++c) {
+      estimate[x] += counts[c][x] / kept;
+    }
+    estimate[x] /= static_cast<double>(n_chains);
+    if (n_chains > 1) {
+      for (std::size_t c = 0; c < n_chains; ++c) {
+        auto d = counts[c][x] / kept - estimate[x];
+        variance[x] += d * d;
+      }
+      variance[x] /= static_cast<double>(n_chains * (n_chains - 1));
+    }
+  }
+  return {detail::make_factor({query}, estimate),
+          detail::make_factor({query}, variance),
+          n_chains * static_cast<std::size_t>(kept)};
+}
+
+}  // namespace pgm
@@ -0,0 +1,66 @@
+#ifndef PGM_SCOPE_LAYOUT_HPP
+#define PGM_SCOPE_LAYOUT_HPP
+// scope_layout.hpp
+// Internal helpers for row-major tables over a list of random variables,
+// shared by the library's translation units.
+
+#include <algorithm>
+#include <cstddef>
+#include <vector>
+
+#include "pgm/factor.hpp"
+
+namespace pgm::detail
+{
+
+// Number of entries in a table over vars.
+inline auto scope_size(const factor::rv_list& vars) -> std::size_t
+{
+  std::size_t size = 1;
+  for (auto v : vars) {
+    size *= static_cast<std::size_t>(v.card());
+  }
+  return size;
+}
+
+// Row-major strides of a table over vars, in entries.
+inline auto scope_strides(const factor::rv_list& vars)
+    -> std::vector<std::size_t>
+{
+  std::vector<std::size_t> strides(vars.size());
+  std::size_t stride = 1;
+  for (auto i = vars.size(); i-- > 0;) {
+    strides[i] = stride;
+    stride *= static_cast<std::size_t>(vars[i].card());
+  }
+  return strides;
+}
+
+// Unravels a row-major flat index over vars into one value per variable.
+inline auto unravel(std::size_t flat, const factor::rv_list& vars)
+    -> std::vector<int>
+{
+  std::vector<int> values(vars.size());
+  for (auto k = vars.size(); k-- > 0;) {
+    auto card = static_cast<std::size_t>(vars[k].card());
+    values[k] = static_cast<int>(flat % card);
+    flat /= card;
+  }
+  return values;
+}
+
+// Builds a factor from values laid out row-major in the order of vars,
+// which need not be sorted.
+inline auto make_factor(const factor::rv_list& vars,
+                        const std::vector<factor::value_type>& values)
+    -> factor
+{
+  auto data = factor::data_array::from_shape(
+      std::vector<std::size_t> {values.size()});
+  std::copy(values.begin(), values.end(), data.begin());
+  return factor(vars, data);
+}
+
+}  // namespace pgm::detail
+
+#endif  // PGM_SCOPE_LAYOUT_HPP
@@ -0,0 +1,321 @@
+// structure.cpp
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "pgm/structure.hpp"
+
+#include "parallel.hpp"
+#include "pgm/factor.hpp"
+#include "pgm/learning.hpp"
+#include "pgm/rv.hpp"
+
+namespace pgm
+{
+
+namespace
+{
+
+using dag = std::vector<std::vector<std::size_t>>;  // parent columns per column
+
+enum class move_kind
+{
+  add,
+  remove,
+  reverse,
+};
+
+// A candidate edit of the edge from -> to.
+struct move
+{
+  move_kind kind;
+  std::size_t from;
+  std::size_t to;
+};
+
+auto has_parent(const dag& parents, std::size_t child, std::size_t parent)
+    -> bool
+{
+  return std::find(parents[child].begin(), parents[child].end(), parent)
+      != parents[child].end();
+}
+
+auto children_of(const dag& parents) -> dag
+{
+  dag children(parents.size());
+  for (std::size_t v = 0; v < parents.size(); ++v) {
+    for (auto p : parents[v]) {
+      children[p].push_back(v);
+    }
+  }
+  return children;
+}
+
+// Whether a directed path leads from source to target, optionally ignoring
+// the single edge skip_from -> skip_to.
+auto reachable(const dag& children,
+               std::size_t source,
+               std::size_t target,
+               std::size_t skip_from = std::numeric_limits<std::size_t>::max(),
+               std::size_t skip_to = std::numeric_limits<std::size_t>::max())
+    -> bool
+{
+  std::vector<bool> visited(children.size(), false);
+  std::vector<std::size_t> stack {source};
+  while (!stack.empty()) {
+    auto v = stack.back();
+    stack.pop_back();
+    if (v == target) {
+      return true;
+    }
+    if (visited[v]) {
+      continue;
+    }
+    visited[v] = true;
+    for (auto c : children[v]) {
+      if (!(v == skip_from && c == skip_to)) {
+        stack.push_back(c);
+      }
+    }
+  }
+  return false;
+}
+
+auto make_family(const assignment_table& data,
+                 std::size_t child,
+                 const std::vector<std::size_t>& parents) -> family
+{
+  family fam {data.columns()[child], {}};
+  for (auto p : parents) {
+    fam.parents.push_back(data.columns()[p]);
+  }
+  return fam;
+}
+
+auto with_parent(std::vector<std::size_t> parents, std::size_t p)
+    -> std::vector<std::size_t>
+{
+  parents.push_back(p);
+  return parents;
+}
+
+auto without_parent(std::vector<std::size_t> parents, std::size_t p)
+    -> std::vector<std::size_t>
+{
+  parents.erase(std::find(parents.begin(), parents.end(), p));
+  return parents;
+}
+
+}  // namespace
+
+
+auto family_score(const factor& counts,
+                  pgm::rv child,
+                  score_type type,
+                  double equivalent_sample_size) -> double
+{
+  const auto& vars = counts.vars();
+  auto child_it = std::find(vars.begin(), vars.end(), child);
+  if (child_it == vars.end()) {
+    throw std::runtime_error("Child is not in the scope of the count table.");
+  }
+  std::size_t child_stride = 1;
+  for (auto it = child_it + 1; it != vars.end(); ++it) {
+    child_stride *= static_cast<std::size_t>(it->card());
+  }
+  auto r = static_cast<std::size_t>(child.card());
+  auto q = counts.data().size() / r;
+
+  // N_ij: counts summed over the child, for each parent configuration j.
+  std::vector<double> parent_counts(q, 0.);
+  double n_total = 0.;
+  std::size_t i = 0;
+  for (auto n_ijk : counts.data()) {
+    auto j = i / (child_stride * r) * child_stride + i % child_stride;
+    parent_counts[j] += n_ijk;
+    n_total += n_ijk;
+    ++i;
+  }
+
+  double score = 0.;
+  if (type == score_type::bic) {
+    i = 0;
+    for (auto n_ijk : counts.data()) {
+      auto j = i / (child_stride * r) * child_stride + i % child_stride;
+      if (n_ijk > 0.) {
+        score += n_ijk * std::log(n_ijk / parent_counts[j]);
+      }
+      ++i;
+    }
+    if (n_total > 0.) {
+      score -= 0.5 * std::log(n_total) * static_cast<double>(q * (r - 1));
+    }
+  } else {
+    auto alpha_j = equivalent_sample_size / static_cast<double>(q);
+    auto alpha_jk = alpha_j / static_cast<double>(r);
+    for (auto n_ij : parent_counts) {
+      score += std::lgamma(alpha_j) - std::lgamma(alpha_j + n_ij);
+    }
+    for (auto n_ijk : counts.data()) {
+      score += std::lgamma(alpha_jk + n_ijk) - std::lgamma(alpha_jk);
+    }
+  }
+  return score;
+}
+
+family_score_cache::family_score_cache(const assignment_table& data,
+                                       score_type type,
+                                       double equivalent_sample_size)
+    : m_data(data)
+    , m_type(type)
+    , m_equivalent_sample_size(equivalent_sample_size)
+{
+}
+
+auto family_score_cache::score(const family& fam) -> double
+{
+  key_type key {fam.child.id(), {}};
+  for (auto p : fam.parents) {
+    key.second.push_back(p.id());
+  }
+  std::sort(key.second.begin(), key.second.end());
+
+  {
+    std::shared_lock lock(m_mutex);
+    auto it = m_scores.find(key);
+    if (it != m_scores.end()) {
+      ++m_hits;
+      return it->second;
+    }
+  }
+  ++m_misses;
+  // Computed outside the lock; two threads may occasionally both compute
+  // the same family, which is harmless.
+  auto counts = count_families(m_data, {fam}, 1);
+  auto result =
+      family_score(counts.front(), fam.child, m_type, m_equivalent_sample_size);
+  std::unique_lock lock(m_mutex);
+  m_scores.emplace(std::move(key), result);
+  return result;
+}
+
+auto hill_climb(const assignment_table& data, const hill_climb_options& options)
+    -> hill_climb_result
+{
+  auto n_threads = detail::resolve_thread_count(options.n_threads);
+  auto n_vars = data.columns().size();
+  family_score_cache cache(data, options.score, options.equivalent_sample_size);
+
+  dag parents(n_vars);
+  std::vector<double> current(n_vars);
+  for (std::size_t v = 0; v < n_vars; ++v) {
+    current[v] = cache.score(make_family(data, v, parents[v]));
+  }
+
+  hill_climb_result result {{}, 0., 0};
+  while (result.iterations < options.max_iterations) {
+    auto children = children_of(parents);
+    std::vector<move> moves;
+    for (std::size_t u = 0; u < n_vars; ++u) {
+      for (std::size_t v = 0; v < n_vars; ++v) {
+        if (u == v) {
+          continue;
+        }
+        if (has_parent(parents, v, u)) {
+          moves.push_back({move_kind::remove, u, v});
+          moves.push_back({move_kind::reverse, u, v});
+        } else if (!has_parent(parents, u, v)) {
+          moves.push_back({move_kind::add, u, v});
+        }
+      }
+    }
+
+    // Score change of each move, or -infinity if the move is illegal.
+    auto delta = [&](const move& m) -> double
+    {
+      auto u = m.from;
+      auto v = m.to;
+      switch (m.kind) {
+        case move_kind::add:
+          if (parents[v].size() >= options.max_parents
+              || reachable(children, v, u))
+          {
+            return -std::numeric_limits<double>::infinity();
+          }
+          return cache.score(make_family(data, v, with_parent(parents[v], u)))
+              - current[v];
+        case move_kind::remove:
+          return cache.score(
+                     make_family(data, v, without_parent(parents[v], u)))
+              - current[v];
+        case move_kind::reverse:
+          if (parents[u].size() >= options.max_parents
+              || reachable(children, u, v, u, v))
+          {
+            return -std::numeric_limits<double>::infinity();
+          }
+          return cache.score(
+                     make_family(data, v, without_parent(parents[v], u)))
+              - current[v]
+              + cache.score(make_family(data, u, with_parent(parents[u], v)))
+              - current[u];
+      }
+      return -std::numeric_limits<double>::infinity();
+    };
+
+    // Each thread finds the best move in its range; ties go to the
+    // earliest move so the search does not depend on the thread count.
+    std::vector<std::pair<double, std::size_t>> best(
+        n_threads, {-std::numeric_limits<double>::infinity(), moves.size()});
+    detail::parallel_for_ranges(
+        moves.size(),
+        n_threads,
+        [&](unsigned t, std::size_t first, std::size_t last)
+        {
+          for (auto i = first; i < last; ++i) {
+            auto d = delta(moves[i]);
+            if (d > best[t].first) {
+              best[t] = {d, i};
+            }
+          }
+        });
+    auto chosen = best.front();
+    for (const auto& candidate : best) {
+      if (candidate.first > chosen.first) {
+        chosen = candidate;
+      }
+    }
+    if (!(chosen.first > 1e-9)) {
+      break;
+    }
+
+    const auto& m = moves[chosen.second];
+    switch (m.kind) {
+      case move_kind::add:
+        parents[m.to].push_back(m.from);
+        break;
+      case move_kind::remove:
+        parents[m.to] = without_parent(parents[m.to], m.from);
+        break;
+      case move_kind::reverse:
+        parents[m.to] = without_parent(parents[m.to], m.from);
+        parents[m.from].push_back(m.to);
+        current[m.from] = cache.score(make_family(data, m.from, parents[m.from]));
+        break;
+    }
+    current[m.to] = cache.score(make_family(data, m.to, parents[m.to]));
+    ++result.iterations;
+  }
+
+  for (std::size_t v = 0; v < n_vars; ++v) {
+    result.families.push_back(make_family(data, v, parents[v]));
+    result.score += current[v];
+  }
+  return result;
+}
+
+}  // namespace pgm
@@ -0,0 +1,374 @@
+// structured_cpd.cpp
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "pgm/structured_cpd.hpp"
+
+#include "pgm/factor.hpp"
+#include "pgm/rv.hpp"
+#include "scope_layout.hpp"
+
+namespace pgm
+{
+
+namespace
+{
+
+void check_distribution(const std::vector<factor::value_type>& p,
+                        std::size_t card)
+{
+  if (p.size() != card) {
+    throw std::runtime_error(
+        "A distribution's size does not match the child's cardinality.");
+  }
+  factor::value_type total = 0.;
+  for (auto x : p) {
+    if (x < 0.) {
+      throw std::runtime_error("A distribution has a negative entry.");
+    }
+    total += x;
+  }
+  if (std::abs(total - 1.) > 1e-6) {
+    throw std::runtime_error("A distribution does not sum to 1.");
+  }
+}
+
+// Collects the tested variables of a tree, checking its shape on the way.
+void check_tree(const tree_cpd::node& n,
+                pgm::rv child,
+                factor::rv_list& path,
+                factor::rv_list& parents)
+{
+  if (!n.test) {
+    check_distribution(n.distribution, static_cast<std::size_t>(child.card()));
+    return;
+  }
+  auto test = *n.test;
+  if (test == child) {
+    throw std::runtime_error("A tree CPD cannot test its own child.");
+  }
+  if (std::find(path.begin(), path.end(), test) != path.end()) {
+    throw std::runtime_error("A tree CPD tests a variable twice on one path.");
+  }
+  if (n.branches.size() != static_cast<std::size_t>(test.card())) {
+    throw std::runtime_error(
+        "A tree CPD split needs one branch per value of its test.");
+  }
+  if (std::find(parents.begin(), parents.end(), test) == parents.end()) {
+    parents.push_back(test);
+  }
+  path.push_back(test);
+  for (const auto& branch : n.branches) {
+    check_tree(branch, child, path, parents);
+  }
+  path.pop_back();
+}
+
+auto reduce_tree(const tree_cpd::node& n, const pgm::rv_evidence& assignments)
+    -> tree_cpd::node
+{
+  if (!n.test) {
+    return n;
+  }
+  auto it = assignments.find(*n.test);
+  if (it != assignments.end()) {
+    return reduce_tree(n.branches.at(static_cast<std::size_t>(it->second)),
+                       assignments);
+  }
+  std::vector<tree_cpd::node> branches;
+  for (const auto& branch : n.branches) {
+    branches.push_back(reduce_tree(branch, assignments));
+  }
+  return tree_cpd::split(*n.test, branches);
+}
+
+// The mixture sum_t weights[t] * trees[t] of trees over the same child.
+// Splits on the first variable any tree tests, restricting every tree to
+// each of its values, until only leaves remain.
+auto mix_trees(const std::vector<tree_cpd::node>& trees,
+               const std::vector<factor::value_type>& weights) -> tree_cpd::node
+{
+  auto split = std::find_if(trees.begin(),
+                            trees.end(),
+                            [](const auto& t) { return t.test.has_value(); });
+  if (split == trees.end()) {
+    std::vector<factor::value_type> distribution(
+        trees.front().distribution.size(), 0.);
+    for (std::size_t t = 0; t < trees.size(); ++t) {
+      for (std::size_t y = 0; y < distribution.size(); ++y) {
+        distribution[y] += weights[t] * trees[t].distribution[y];
+      }
+    }
+    return tree_cpd::leaf(distribution);
+  }
+  auto test = *split->test;
+  std::vector<tree_cpd::node> branches;
+  for (int value = 0; value < test.card(); ++value) {
+    pgm::rv_evidence assignment;
+    assignment[test] = value;
+    std::vector<tree_cpd::node> restricted;
+    for (const auto& t : trees) {
+      restricted.push_back(reduce_tree(t, assignment));
+    }
+    branches.push_back(mix_trees(restricted, weights));
+  }
+  return tree_cpd::split(test, branches);
+}
+
+auto sum_out_tree(const tree_cpd::node& n,
+                  pgm::rv parent,
+                  const std::vector<factor::value_type>& prior)
+    -> tree_cpd::node
+{
+  if (!n.test) {
+    return n;
+  }
+  if (*n.test == parent) {
+    return mix_trees(n.branches, prior);
+  }
+  std::vector<tree_cpd::node> branches;
+  for (const auto& branch : n.branches) {
+    branches.push_back(sum_out_tree(branch, parent, prior));
+  }
+  return tree_cpd::split(*n.test, branches);
+}
+
+auto tree_size(const tree_cpd::node& n) -> std::size_t
+{
+  auto size = n.distribution.size();
+  for (const auto& branch : n.branches) {
+    size += tree_size(branch);
+  }
+  return size;
+}
+
+void collect_rules(const tree_cpd::node& n,
+                   pgm::rv child,
+                   std::vector<std::pair<pgm::rv, int>>& context,
+                   std::vector<factor>& rules)
+{
+  if (n.test) {
+    for (std::size_t b = 0; b < n.branches.size(); ++b) {
+      context.emplace_back(*n.test, static_cast<int>(b));
+      collect_rules(n.branches[b], child, context, rules);
+      context.pop_back();
+    }
+    return;
+  }
+  factor::rv_list vars;
+  for (const auto& [v, value] : context) {
+    vars.push_back(v);
+  }
+  vars.push_back(child);
+
+  std::vector<factor::value_type> values(detail::scope_size(vars));
+  for (std::size_t flat = 0; flat < values.size(); ++flat) {
+    auto assignment = detail::unravel(flat, vars);
+    bool in_context = true;
+    for (std::size_t k = 0; k < context.size(); ++k) {
+      in_context = in_context && assignment[k] == context[k].second;
+    }
+    values[flat] = in_context ? n.distribution[assignment.back()] : 1.;
+  }
+  rules.push_back(detail::make_factor(vars, values));
+}
+
+}  // namespace
+
+
+noisy_max_cpd::noisy_max_cpd(
+    pgm::rv child,
+    const factor::rv_list& parents,
+    const std::vector<std::vector<factor::value_type>>& levels,
+    const std::vector<factor::value_type>& leak)
+    : m_child(child)
+    , m_parents(parents)
+    , m_levels(levels)
+    , m_leak(leak)
+{
+  auto k = static_cast<std::size_t>(child.card());
+  if (levels.size() != parents.size()) {
+    throw std::runtime_error("A noisy-MAX CPD needs one level table per parent.");
+  }
+  check_distribution(leak, k);
+  for (std::size_t i = 0; i < parents.size(); ++i) {
+    if (parents[i] == child) {
+      throw std::runtime_error("A noisy-MAX CPD's child cannot be its parent.");
+    }
+    auto card = static_cast<std::size_t>(parents[i].card());
+    if (levels[i].size() != card * k) {
+      throw std::runtime_error(
+          "A noisy-MAX level table must have one row per parent value.");
+    }
+    for (auto row = levels[i].begin(); row != levels[i].end(); row += k) {
+      check_distribution({row, row + static_cast<std::ptrdiff_t>(k)}, k);
+    }
+  }
+}
+
+auto noisy_max_cpd::decompose() const -> noisy_max_decomposition
+{
+  auto k = static_cast<std::size_t>(m_child.card());
+  pgm::rv auxiliary(m_child.card());
+  noisy_max_decomposition result {auxiliary, {}};
+
+  std::vector<factor::value_type> difference(k * k, 0.);
+  for (std::size_t y = 0; y < k; ++y) {
+    difference[y * k + y] = 1.;
+    if (y > 0) {
+      difference[y * k + y - 1] = -1.;
+    }
+  }
+  result.factors.push_back(
+      detail::make_factor(factor::rv_list {m_child, auxiliary}, difference));
+
+  auto cumulative = [k](auto first)
+  {
+    std::vector<factor::value_type> c(k);
+    std::partial_sum(first, first + static_cast<std::ptrdiff_t>(k), c.begin());
+    return c;
+  };
+  result.factors.push_back(
+      detail::make_factor(factor::rv_list {auxiliary},
+                          cumulative(m_leak.begin())));
+  for (std::size_t i = 0; i < m_parents.size(); ++i) {
+    std::vector<factor::value_type> values;
+    for (auto row = m_levels[i].begin(); row != m_levels[i].end(); row += k) {
+      auto c = cumulative(row);
+      values.insert(values.end(), c.begin(), c.end());
+    }
+    result.factors.push_back(
+        detail::make_factor(factor::rv_list {m_parents[i], auxiliary}, values));
+  }
+  return result;
+}
+
+auto noisy_max_cpd::to_factor() const -> factor
+{
+  auto k = static_cast<std::size_t>(m_child.card());
+  auto parent_configs = detail::scope_size(m_parents);
+  std::vector<factor::value_type> values;
+  values.reserve(parent_configs * k);
+  std::vector<factor::value_type> cdf(k);
+  for (std::size_t config = 0; config < parent_configs; ++config) {
+    auto x = detail::unravel(config, m_parents);
+    factor::value_type leak_cdf = 0.;
+    for (std::size_t y = 0; y < k; ++y) {
+      leak_cdf += m_leak[y];
+      cdf[y] = leak_cdf;
+    }
+    for (std::size_t i = 0; i < m_parents.size(); ++i) {
+      factor::value_type parent_cdf = 0.;
+      for (std::size_t y = 0; y < k; ++y) {
+        parent_cdf += m_levels[i][static_cast<std::size_t>(x[i]) * k + y];
+        cdf[y] *= parent_cdf;
+      }
+    }
+    for (std::size_t y = 0; y < k; ++y) {
+      values.push_back(y == 0 ? cdf[0] : cdf[y] - cdf[y - 1]);
+    }
+  }
+  auto vars = m_parents;
+  vars.push_back(m_child);
+  return detail::make_factor(vars, values);
+}
+
+auto make_noisy_or(pgm::rv child,
+                   const factor::rv_list& parents,
+                   const std::vector<factor::value_type>& activation,
+                   factor::value_type leak) -> noisy_max_cpd
+{
+  if (child.card() != 2
+      || std::any_of(parents.begin(),
+                     parents.end(),
+                     [](auto v) { return v.card() != 2; }))
+  {
+    throw std::runtime_error("Noisy-OR variables must be binary.");
+  }
+  if (activation.size() != parents.size()) {
+    throw std::runtime_error("Noisy-OR needs one activation per parent.");
+  }
+  std::vector<std::vector<factor::value_type>> levels;
+  for (auto p : activation) {
+    levels.push_back({1., 0., 1. - p, p});
+  }
+  return noisy_max_cpd(child, parents, levels, {1. - leak, leak});
+}
+
+
+auto tree_cpd::leaf(const std::vector<factor::value_type>& distribution) -> node
+{
+  return {std::nullopt, {}, distribution};
+}
+
+auto tree_cpd::split(pgm::rv test, const std::vector<node>& branches) -> node
+{
+  return {test, branches, {}};
+}
+
+tree_cpd::tree_cpd(pgm::rv child, const node& root)
+    : m_child(child)
+    , m_root(root)
+{
+  factor::rv_list path;
+  check_tree(m_root, m_child, path, m_parents);
+  std::sort(m_parents.begin(), m_parents.end(), pgm::rv_id_comparison());
+}
+
+auto tree_cpd::reduction(const pgm::rv_evidence& assignments) const -> tree_cpd
+{
+  return tree_cpd(m_child, reduce_tree(m_root, assignments));
+}
+
+auto tree_cpd::marginalization(pgm::rv parent, const factor& prior) const
+    -> tree_cpd
+{
+  if (!(prior.vars() == factor::rv_list {parent})) {
+    throw std::runtime_error(
+        "A tree CPD can only sum out a parent against a factor over it.");
+  }
+  auto normalized = factor_normalization(prior);
+  std::vector<factor::value_type> weights(normalized.data().begin(),
+                                          normalized.data().end());
+  return tree_cpd(m_child, sum_out_tree(m_root, parent, weights));
+}
+
+auto tree_cpd::size() const -> std::size_t
+{
+  return tree_size(m_root);
+}
+
+auto tree_cpd::rule_factors() const -> std::vector<factor>
+{
+  std::vector<std::pair<pgm::rv, int>> context;
+  std::vector<factor> rules;
+  collect_rules(m_root, m_child, context, rules);
+  return rules;
+}
+
+auto tree_cpd::to_factor() const -> factor
+{
+  auto parent_configs = detail::scope_size(m_parents);
+  auto k = static_cast<std::size_t>(m_child.card());
+  std::vector<factor::value_type> values;
+  values.reserve(parent_configs * k);
+  for (std::size_t config = 0; config < parent_configs; ++config) {
+    auto x = detail::unravel(config, m_parents);
+    const node* n = &m_root;
+    while (n->test) {
+      auto it = std::find(m_parents.begin(), m_parents.end(), *n->test);
+      n = &n->branches[static_cast<std::size_t>(x[it - m_parents.begin()])];
+    }
+    values.insert(values.end(), n->distribution.begin(), n->distribution.end());
+  }
+  auto vars = m_parents;
+  vars.push_back(m_child);
+  return detail::make_factor(vars, values);
+}
+
+}  // namespace pgm
@@ -0,0 +1,39 @@
+#ifndef PGM_TEST_SCRATCH_FILE_HPP
+#define PGM_TEST_SCRATCH_FILE_HPP
+// scratch_file.hpp
+
+#include <atomic>
+#include <filesystem>
+#include <string>
+#include <system_error>
+
+#include <unistd.h>
+
+// scratch_file names a file in the temporary directory that no other test
+// process uses, and removes the file when it goes out of scope.
+class scratch_file
+{
+private:
+  std::string m_path;
+
+public:
+  explicit scratch_file(const std::string& name)
+  {
+    static std::atomic<unsigned> counter {0};
+    m_path = (std::filesystem::temp_directory_path()
+              / ("pgm_test_" + std::to_string(::getpid()) + "_"
+                 + std::to_string(counter++) + "_" + name))
+                 .string();
+  }
+  scratch_file(const scratch_file&) = delete;
+  auto operator=(const scratch_file&) -> scratch_file& = delete;
+  ~scratch_file()
+  {
+    std::error_code ec;
+    std::filesystem::remove(m_path, ec);
+  }
+
+  auto path() const -> const std::string& { return m_path; }
+};
+
+#endif  // PGM_TEST_SCRATCH_FILE_HPP
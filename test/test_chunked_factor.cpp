@@ -0,0 +1,117 @@
+// test_chunked_factor.cpp
+
+#include <filesystem>
+#include <stdexcept>
+#include <catch2/catch_test_macros.hpp>
+
+#include "pgm/chunked_factor.hpp"
+#include "pgm/factor.hpp"
+#include "scratch_file.hpp"
+
+TEST_CASE("Chunked Factor Storage", "[chunked_factor]")
+{
+  auto rv_A = pgm::rv {3};
+  auto rv_B = pgm::rv {2};
+
+  pgm::factor f_AB(pgm::factor::rv_list {rv_A, rv_B},
+                   {{0.5, 0.8, 0.1, 0.0, 0.3, 0.9}});
+
+  SECTION("Tiles span whole blocks of the trailing scope variables")
+  {
+    scratch_file file("AB");
+    auto c_AB = pgm::chunked_factor::from_factor(f_AB, file.path(), 2);
+    CHECK(c_AB.tile_size() == 2);
+    CHECK(c_AB.tile_axes() == 1);
+    CHECK(c_AB.tile_count() == 3);
+    REQUIRE(c_AB.to_factor() == f_AB);
+  }
+
+  SECTION("A stored factor can be reopened from its file")
+  {
+    scratch_file file("AB_reopen");
+    pgm::chunked_factor::from_factor(f_AB, file.path());
+    auto c_AB = pgm::chunked_factor::open(f_AB.vars(), file.path());
+    REQUIRE(c_AB.to_factor() == f_AB);
+  }
+
+  SECTION("A chunked factor's scope must already be sorted")
+  {
+    scratch_file file("BA");
+    CHECK_THROWS_AS(
+        pgm::chunked_factor(pgm::factor::rv_list {rv_B, rv_A}, file.path()),
+        std::runtime_error);
+    CHECK_FALSE(std::filesystem::exists(file.path()));
+  }
+}
+
+TEST_CASE("Chunked Factor Operations", "[chunked_factor][operation]")
+{
+  auto rv_A = pgm::rv {3};
+  auto rv_B = pgm::rv {2};
+  auto rv_C = pgm::rv {2};
+
+  pgm::factor f_AB(pgm::factor::rv_list {rv_A, rv_B},
+                   {{0.5, 0.8, 0.1, 0.0, 0.3, 0.9}});
+  pgm::factor f_BC(pgm::factor::rv_list {rv_B, rv_C},
+                   {{0.5, 0.7, 0.1, 0.2}});
+  auto f_ABC = pgm::factor_product(f_AB, f_BC);
+
+  // A tile budget of 2 elements forces several tiles per table.
+  scratch_file file_AB("op_AB");
+  scratch_file file_BC("op_BC");
+  scratch_file file_ABC("op_ABC");
+  scratch_file file_AC("op_AC");
+  scratch_file file_BC_sum("op_BC_sum");
+  auto c_AB = pgm::chunked_factor::from_factor(f_AB, file_AB.path(), 2);
+  auto c_BC = pgm::chunked_factor::from_factor(f_BC, file_BC.path(), 2);
+
+  SECTION("Streamed product matches the in-memory product")
+  {
+    auto c_ABC = pgm::chunked_factor_product(c_AB, c_BC, file_ABC.path(), 2);
+    REQUIRE(is_close(c_ABC.to_factor(), f_ABC));
+  }
+
+  SECTION("Streamed marginalization matches the in-memory marginalization")
+  {
+    auto c_ABC = pgm::chunked_factor::from_factor(f_ABC, file_ABC.path(), 2);
+    auto c_AC = pgm::chunked_factor_marginalization(
+        c_ABC, {rv_B}, file_AC.path(), 2);
+    REQUIRE(is_close(c_AC.to_factor(), pgm::factor_marginalization(f_ABC, rv_B)));
+
+    // Summing out the leading variable gathers across the whole input.
+    auto c_BC_sum = pgm::chunked_factor_marginalization(
+        c_ABC, {rv_A}, file_BC_sum.path(), 2);
+    REQUIRE(is_close(c_BC_sum.to_factor(),
+                     pgm::factor_marginalization(f_ABC, rv_A)));
+  }
+
+  SECTION("Streamed reduction matches the in-memory reduction")
+  {
+    auto c_ABC = pgm::chunked_factor::from_factor(f_ABC, file_ABC.path(), 2);
+    pgm::rv_evidence evidence;
+    evidence[rv_B] = 1;
+    auto c_AC =
+        pgm::chunked_factor_reduction(c_ABC, evidence, file_AC.path(), 2);
+    REQUIRE(is_close(c_AC.to_factor(), pgm::factor_reduction(f_ABC, evidence)));
+  }
+
+  SECTION("Reduction rejects out-of-range evidence")
+  {
+    pgm::rv_evidence evidence;
+    evidence[rv_A] = 3;
+    CHECK_THROWS_AS(
+        pgm::chunked_factor_reduction(c_AB, evidence, file_AC.path(), 2),
+        std::runtime_error);
+    CHECK_FALSE(std::filesystem::exists(file_AC.path()));
+  }
+
+  SECTION("The output cannot overwrite an operand's file")
+  {
+    CHECK_THROWS_AS(pgm::chunked_factor_product(c_AB, c_BC, file_BC.path(), 2),
+                    std::runtime_error);
+    CHECK_THROWS_AS(
+        pgm::chunked_factor_marginalization(c_AB, {rv_B}, file_AB.path(), 2),
+        std::runtime_error);
+    REQUIRE(c_BC.to_factor() == f_BC);
+  }
+}
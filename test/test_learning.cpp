@@ -0,0 +1,134 @@
+// test_learning.cpp
+
+#include <cstdint>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "pgm/factor.hpp"
+#include "pgm/learning.hpp"
+#include "scratch_file.hpp"
+
+TEST_CASE("Family Counting", "[learning]")
+{
+  auto rv_A = pgm::rv {2};
+  auto rv_B = pgm::rv {3};
+
+  // Columns are given as {B, A}; the count table is still in id order.
+  std::vector<std::int32_t> values {0, 1,  2, 1,  2, 1,  1, 0,  -1, 0};
+  pgm::assignment_table data(values, {rv_B, rv_A});
+  std::vector<pgm::family> families {{rv_A, {}}, {rv_B, {rv_A}}};
+
+  SECTION("Rows missing a value in a family's scope are skipped for it")
+  {
+    auto counts = pgm::count_families(data, families, 1);
+    CHECK(counts[0] == pgm::factor(pgm::factor::rv_list {rv_A}, {{2, 3}}));
+    CHECK(counts[1]
+          == pgm::factor(pgm::factor::rv_list {rv_A, rv_B},
+                         {{0, 1, 0, 1, 0, 2}}));
+  }
+
+  SECTION("Values beyond a variable's cardinality are rejected")
+  {
+    std::vector<std::int32_t> bad {0, 1, 2, 5};
+    pgm::assignment_table bad_data(bad, {rv_B, rv_A});
+    CHECK_THROWS_AS(pgm::count_families(bad_data, families, 2),
+                    std::runtime_error);
+  }
+
+  SECTION("Counts do not depend on the number of threads")
+  {
+    REQUIRE(pgm::count_families(data, families, 1)
+            == pgm::count_families(data, families, 4));
+  }
+
+  SECTION("Rows can be streamed from a memory-mapped file")
+  {
+    scratch_file rows("rows");
+    std::ofstream(rows.path(), std::ios::binary)
+        .write(reinterpret_cast<const char*>(values.data()),
+               static_cast<std::streamsize>(values.size() * sizeof(values[0])));
+    auto file = pgm::assignment_file::open(rows.path(), {rv_B, rv_A});
+    REQUIRE(pgm::count_families(file.table(), families, 2)
+            == pgm::count_families(data, families, 1));
+  }
+}
+
+TEST_CASE("Conditional Normalization", "[learning]")
+{
+  auto rv_A = pgm::rv {2};
+  auto rv_B = pgm::rv {2};
+  pgm::factor counts(pgm::factor::rv_list {rv_A, rv_B}, {{1, 3, 0, 0}});
+
+  SECTION("Each parent configuration is normalized over the child")
+  {
+    pgm::factor expected(pgm::factor::rv_list {rv_A, rv_B},
+                         {{0.25, 0.75, 0.5, 0.5}});
+    REQUIRE(is_close(pgm::conditional_normalization(counts, rv_B), expected));
+  }
+
+  SECTION("A pseudocount smooths every cell")
+  {
+    pgm::factor expected(pgm::factor::rv_list {rv_A, rv_B},
+                         {{2. / 6, 4. / 6, 0.5, 0.5}});
+    REQUIRE(
+        is_close(pgm::conditional_normalization(counts, rv_B, 1.), expected));
+  }
+
+  SECTION("A child with no counts at all gets a uniform distribution")
+  {
+    pgm::factor root_counts(pgm::factor::rv_list {rv_B}, {{0, 0}});
+    REQUIRE(pgm::conditional_normalization(root_counts, rv_B)
+            == pgm::factor(pgm::factor::rv_list {rv_B}, {{0.5, 0.5}}));
+  }
+}
+
+TEST_CASE("Expectation Maximization", "[learning]")
+{
+  auto rv_A = pgm::rv {2};
+  auto rv_B = pgm::rv {2};
+  std::vector<pgm::family> families {{rv_A, {}}, {rv_B, {rv_A}}};
+  pgm::factor true_A(pgm::factor::rv_list {rv_A}, {{0.3, 0.7}});
+  pgm::factor true_B(pgm::factor::rv_list {rv_A, rv_B},
+                     {{0.9, 0.1, 0.2, 0.8}});
+
+  // Sample A -> B, hiding A in a third of the rows.
+  std::mt19937 gen(7);
+  std::uniform_real_distribution<> unif;
+  std::vector<std::int32_t> values;
+  for (int i = 0; i < 20000; ++i) {
+    int a = unif(gen) < 0.7 ? 1 : 0;
+    int b = unif(gen) < (a == 1 ? 0.8 : 0.1) ? 1 : 0;
+    values.push_back(i % 3 == 0 ? -1 : a);
+    values.push_back(b);
+  }
+  pgm::assignment_table data(values, {rv_A, rv_B});
+
+  pgm::em_options options;
+  options.pseudocount = 0.;
+  auto result = pgm::fit_cpds_em(data, families, {}, options);
+
+  REQUIRE(result.converged);
+  CHECK(is_close(result.cpds[0], true_A, 0., 0.02));
+  CHECK(is_close(result.cpds[1], true_B, 0., 0.02));
+
+  SECTION("Initial CPDs must match the families")
+  {
+    CHECK_THROWS_AS(pgm::fit_cpds_em(data, families, {true_A}, options),
+                    std::runtime_error);
+    CHECK_THROWS_AS(
+        pgm::fit_cpds_em(data, families, {true_B, true_A}, options),
+        std::runtime_error);
+  }
+
+  SECTION("Without a pattern table, rows are visited one at a time")
+  {
+    options.max_patterns = 1;
+    auto streamed = pgm::fit_cpds_em(data, families, {}, options);
+    CHECK(streamed.iterations == result.iterations);
+    CHECK(is_close(streamed.cpds[0], result.cpds[0]));
+    CHECK(is_close(streamed.cpds[1], result.cpds[1]));
+  }
+}
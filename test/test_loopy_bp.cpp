@@ -0,0 +1,112 @@
+// test_loopy_bp.cpp
+
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "pgm/factor.hpp"
+#include "pgm/loopy_bp.hpp"
+
+namespace
+{
+
+auto exact_marginal(const std::vector<pgm::factor>& factors, pgm::rv v)
+    -> pgm::factor
+{
+  auto joint = factors.front();
+  for (std::size_t i = 1; i < factors.size(); ++i) {
+    joint = pgm::factor_product(joint, factors[i]);
+  }
+  pgm::factor::rv_list summed;
+  for (auto u : joint.vars()) {
+    if (!(u == v)) {
+      summed.push_back(u);
+    }
+  }
+  return pgm::factor_normalization(pgm::factor_marginalization(joint, summed));
+}
+
+}  // namespace
+
+TEST_CASE("Belief Propagation on a Tree", "[loopy_bp]")
+{
+  pgm::rv D(2), I(2), G(3), S(2);
+  std::vector<pgm::factor> factors {
+      pgm::factor(pgm::factor::rv_list {D}, {{0.6, 0.4}}),
+      pgm::factor(pgm::factor::rv_list {I}, {{0.7, 0.3}}),
+      pgm::factor(pgm::factor::rv_list {I, D, G},
+                  {{0.3, 0.4, 0.3, 0.05, 0.25, 0.7,
+                    0.9, 0.08, 0.02, 0.5, 0.3, 0.2}}),
+      pgm::factor(pgm::factor::rv_list {I, S}, {{0.95, 0.05, 0.2, 0.8}}),
+  };
+
+  auto graph = pgm::cluster_graph::bethe(factors);
+  auto result = graph.run();
+
+  REQUIRE(result.converged);
+  for (auto v : {D, I, G, S}) {
+    CHECK(is_close(graph.marginal(v), exact_marginal(factors, v)));
+  }
+}
+
+TEST_CASE("Belief Propagation with Zero Entries", "[loopy_bp]")
+{
+  // Deterministic entries make some messages 0, which the belief division
+  // must not turn into NaN.
+  pgm::rv A(2), B(3), C(2);
+  std::vector<pgm::factor> factors {
+      pgm::factor(pgm::factor::rv_list {A}, {{0., 1.}}),
+      pgm::factor(pgm::factor::rv_list {A, B}, {{1, 0, 0, 0, 0.5, 0.5}}),
+      pgm::factor(pgm::factor::rv_list {B, C}, {{0, 1, 0.3, 0.7, 1, 0}}),
+  };
+
+  auto graph = pgm::cluster_graph::bethe(factors);
+  REQUIRE(graph.run().converged);
+  for (auto v : {A, B, C}) {
+    CHECK(is_close(graph.marginal(v), exact_marginal(factors, v)));
+  }
+}
+
+TEST_CASE("Loopy Belief Propagation", "[loopy_bp]")
+{
+  // A four-cycle with weak couplings, on which loopy BP is accurate.
+  pgm::rv A(2), B(2), C(2), D(2);
+  std::vector<pgm::factor> factors {
+      pgm::factor(pgm::factor::rv_list {A, B}, {{3, 1, 1, 2}}),
+      pgm::factor(pgm::factor::rv_list {B, C}, {{2, 1, 1, 2}}),
+      pgm::factor(pgm::factor::rv_list {C, D}, {{1, 2, 2, 1}}),
+      pgm::factor(pgm::factor::rv_list {D, A}, {{2, 1, 1, 1}}),
+  };
+
+  SECTION("Residual scheduling converges to approximate marginals")
+  {
+    auto graph = pgm::cluster_graph::bethe(factors);
+    auto result = graph.run();
+    REQUIRE(result.converged);
+    CHECK(result.max_residual < 1e-6);
+    for (auto v : {A, B, C, D}) {
+      CHECK(is_close(graph.marginal(v), exact_marginal(factors, v), 0., 0.05));
+    }
+  }
+
+  SECTION("Damping reaches the same fixed point")
+  {
+    auto undamped = pgm::cluster_graph::bethe(factors);
+    undamped.run();
+    auto graph = pgm::cluster_graph::bethe(factors);
+    pgm::bp_options options;
+    options.damping = 0.5;
+    options.tolerance = 1e-9;
+    REQUIRE(graph.run(options).converged);
+    CHECK(is_close(graph.marginal(A), undamped.marginal(A), 0., 1e-5));
+  }
+
+  SECTION("The update budget bounds the work done")
+  {
+    auto graph = pgm::cluster_graph::bethe(factors);
+    pgm::bp_options options;
+    options.max_updates = 3;
+    auto result = graph.run(options);
+    CHECK(!result.converged);
+    CHECK(result.updates == 3);
+  }
+}
@@ -0,0 +1,156 @@
+// test_sampling.cpp
+
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "pgm/factor.hpp"
+#include "pgm/learning.hpp"
+#include "pgm/sampling.hpp"
+#include "pgm/structured_cpd.hpp"
+
+TEST_CASE("Sampling Inference", "[sampling]")
+{
+  // The student network without the letter, with families listed out of
+  // topological order.  P(i1 | g3) ~ 0.079 and P(d1 | g3) ~ 0.629.
+  pgm::rv D(2), I(2), G(3), S(2);
+  std::vector<pgm::family> families {
+      {G, {I, D}},
+      {D, {}},
+      {S, {I}},
+      {I, {}},
+  };
+  std::vector<pgm::factor> cpds {
+      pgm::factor(pgm::factor::rv_list {I, D, G},
+                  {{0.3, 0.4, 0.3, 0.05, 0.25, 0.7,
+                    0.9, 0.08, 0.02, 0.5, 0.3, 0.2}}),
+      pgm::factor(pgm::factor::rv_list {D}, {{0.6, 0.4}}),
+      pgm::factor(pgm::factor::rv_list {I, S}, {{0.95, 0.05, 0.2, 0.8}}),
+      pgm::factor(pgm::factor::rv_list {I}, {{0.7, 0.3}}),
+  };
+  pgm::network_sampler sampler(families, cpds);
+  pgm::rv_evidence evidence;
+  evidence[G] = 2;
+
+  SECTION("Likelihood weighting estimates posterior marginals")
+  {
+    pgm::likelihood_weighting_options options;
+    options.max_samples = 200000;
+    auto result = sampler.likelihood_weighting(I, evidence, options);
+    CHECK(result.samples == 200000);
+    CHECK(is_close(result.estimate,
+                   pgm::factor(pgm::factor::rv_list {I}, {{0.921, 0.079}}),
+                   0.,
+                   0.01));
+    CHECK(result.variance.data()(1) > 0.);
+    CHECK(result.variance.data()(1) < 1e-4);
+  }
+
+  SECTION("Results depend on the seed but not on the thread count")
+  {
+    pgm::likelihood_weighting_options options;
+    options.max_samples = 10000;
+    options.batch_size = 1000;
+    options.n_threads = 1;
+    auto serial = sampler.likelihood_weighting(D, evidence, options);
+    options.n_threads = 4;
+    auto parallel = sampler.likelihood_weighting(D, evidence, options);
+    CHECK(serial.estimate == parallel.estimate);
+    CHECK(serial.variance == parallel.variance);
+
+    options.seed = 1;
+    CHECK(sampler.likelihood_weighting(D, evidence, options).estimate
+          != serial.estimate);
+  }
+
+  SECTION("Gibbs sampling estimates posterior marginals reproducibly")
+  {
+    pgm::gibbs_options options;
+    options.n_chains = 32;
+    options.max_sweeps = 2000;
+    options.n_threads = 1;
+    auto serial = sampler.gibbs(D, evidence, options);
+    CHECK(is_close(serial.estimate,
+                   pgm::factor(pgm::factor::rv_list {D}, {{0.371, 0.629}}),
+                   0.,
+                   0.02));
+    options.n_threads = 3;
+    CHECK(sampler.gibbs(D, evidence, options).estimate == serial.estimate);
+  }
+
+  SECTION("A past deadline returns the current estimate")
+  {
+    pgm::likelihood_weighting_options options;
+    options.n_threads = 1;
+    options.deadline = std::chrono::steady_clock::now();
+    CHECK(sampler.likelihood_weighting(I, evidence, options).samples
+          == options.batch_size);
+
+    // The deadline stops burn-in after its first round.
+    pgm::gibbs_options gibbs_options;
+    gibbs_options.burn_in = 10;
+    gibbs_options.sweeps_per_round = 5;
+    gibbs_options.deadline = std::chrono::steady_clock::now();
+    auto result = sampler.gibbs(I, evidence, gibbs_options);
+    CHECK(result.samples == gibbs_options.n_chains);
+    CHECK(result.estimate.data()(0) + result.estimate.data()(1) == 1.);
+  }
+
+  SECTION("Evidence values must lie within the variable's cardinality")
+  {
+    pgm::rv_evidence bad;
+    bad[G] = 3;
+    CHECK_THROWS_AS(sampler.likelihood_weighting(I, bad), std::runtime_error);
+    bad[G] = -1;
+    CHECK_THROWS_AS(sampler.gibbs(I, bad), std::runtime_error);
+  }
+}
+
+TEST_CASE("Sampling with Noisy-MAX CPDs", "[sampling]")
+{
+  pgm::rv A(2), B(2), C(3), Y(3);
+  std::vector<pgm::family> roots {{A, {}}, {B, {}}, {C, {}}};
+  std::vector<pgm::factor> priors {
+      pgm::factor(pgm::factor::rv_list {A}, {{0.6, 0.4}}),
+      pgm::factor(pgm::factor::rv_list {B}, {{0.3, 0.7}}),
+      pgm::factor(pgm::factor::rv_list {C}, {{0.5, 0.3, 0.2}}),
+  };
+  pgm::noisy_max_cpd cpd(Y,
+                         {A, B, C},
+                         {{1., 0., 0., 0.2, 0.5, 0.3},
+                          {1., 0., 0., 0.6, 0.4, 0.},
+                          {1., 0., 0., 0.3, 0.7, 0., 0.1, 0.1, 0.8}},
+                         {0.9, 0.1, 0.});
+
+  pgm::network_sampler sampler(roots, priors, {cpd});
+  auto dense_families = roots;
+  dense_families.push_back({Y, {A, B, C}});
+  auto dense_cpds = priors;
+  dense_cpds.push_back(cpd.to_factor());
+  pgm::network_sampler dense(dense_families, dense_cpds);
+
+  pgm::rv_evidence evidence;
+  evidence[Y] = 2;
+
+  SECTION("Likelihood weighting matches the dense network")
+  {
+    pgm::likelihood_weighting_options options;
+    options.max_samples = 100000;
+    CHECK(is_close(sampler.likelihood_weighting(C, evidence, options).estimate,
+                   dense.likelihood_weighting(C, evidence, options).estimate,
+                   0.,
+                   0.01));
+  }
+
+  SECTION("Gibbs sampling matches the dense network")
+  {
+    pgm::gibbs_options options;
+    options.n_chains = 32;
+    options.max_sweeps = 2000;
+    CHECK(is_close(sampler.gibbs(A, evidence, options).estimate,
+                   dense.gibbs(A, evidence, options).estimate,
+                   0.,
+                   0.02));
+  }
+}
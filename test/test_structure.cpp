@@ -0,0 +1,97 @@
+// test_structure.cpp
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <vector>
+#include <catch2/catch_approx.hpp>
+#include <catch2/catch_test_macros.hpp>
+
+#include "pgm/factor.hpp"
+#include "pgm/learning.hpp"
+#include "pgm/structure.hpp"
+
+TEST_CASE("Family Scores", "[structure]")
+{
+  auto rv_A = pgm::rv {2};
+  auto rv_B = pgm::rv {2};
+  pgm::factor counts(pgm::factor::rv_list {rv_A, rv_B}, {{3, 1, 0, 4}});
+
+  SECTION("BIC is the log-likelihood less a complexity penalty")
+  {
+    auto expected = 3 * std::log(0.75) + 1 * std::log(0.25) + 4 * std::log(1.)
+        - 0.5 * std::log(8.) * 2;
+    CHECK(pgm::family_score(counts, rv_B, pgm::score_type::bic)
+          == Catch::Approx(expected));
+  }
+
+  SECTION("BDeu is the log marginal likelihood under a uniform Dirichlet")
+  {
+    // alpha_j = 1, alpha_jk = 0.5
+    auto expected = 2 * std::lgamma(1.) - std::lgamma(5.) - std::lgamma(5.)
+        + std::lgamma(3.5) + std::lgamma(1.5) + std::lgamma(0.5)
+        + std::lgamma(4.5) - 4 * std::lgamma(0.5);
+    CHECK(pgm::family_score(counts, rv_B, pgm::score_type::bdeu, 2.)
+          == Catch::Approx(expected));
+  }
+}
+
+TEST_CASE("Structure Search", "[structure]")
+{
+  auto rv_A = pgm::rv {2};
+  auto rv_B = pgm::rv {2};
+  auto rv_C = pgm::rv {2};
+
+  // B copies A most of the time; C is independent noise.
+  std::mt19937 gen(11);
+  std::uniform_real_distribution<> unif;
+  std::vector<std::int32_t> values;
+  for (int i = 0; i < 5000; ++i) {
+    int a = unif(gen) < 0.5 ? 1 : 0;
+    int b = unif(gen) < 0.9 ? a : 1 - a;
+    int c = unif(gen) < 0.5 ? 1 : 0;
+    values.insert(values.end(), {a, b, c});
+  }
+  pgm::assignment_table data(values, {rv_A, rv_B, rv_C});
+
+  SECTION("Repeated family scores are served from the cache")
+  {
+    pgm::family_score_cache cache(data, pgm::score_type::bic);
+    auto first = cache.score({rv_B, {rv_A}});
+    CHECK(cache.score({rv_B, {rv_A}}) == first);
+    CHECK(cache.misses() == 1);
+    CHECK(cache.hits() == 1);
+  }
+
+  SECTION("A cache can be built from a temporary view of the data")
+  {
+    pgm::family_score_cache cache(
+        pgm::assignment_table(values, {rv_A, rv_B, rv_C}),
+        pgm::score_type::bic);
+    pgm::family_score_cache reference(data, pgm::score_type::bic);
+    CHECK(cache.score({rv_B, {rv_A}}) == reference.score({rv_B, {rv_A}}));
+  }
+
+  SECTION("Hill climbing links the dependent pair and nothing else")
+  {
+    auto result = pgm::hill_climb(data);
+    std::size_t n_edges = 0;
+    for (const auto& fam : result.families) {
+      n_edges += fam.parents.size();
+    }
+    CHECK(n_edges == 1);
+    CHECK(result.families[2].parents.empty());
+  }
+
+  SECTION("The search does not depend on the number of threads")
+  {
+    pgm::hill_climb_options options;
+    options.score = pgm::score_type::bdeu;
+    options.n_threads = 1;
+    auto serial = pgm::hill_climb(data, options);
+    options.n_threads = 4;
+    auto parallel = pgm::hill_climb(data, options);
+    CHECK(serial.score == parallel.score);
+    CHECK(serial.iterations == parallel.iterations);
+  }
+}
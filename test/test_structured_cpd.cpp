@@ -0,0 +1,195 @@
+// test_structured_cpd.cpp
+
+#include <stdexcept>
+#include <vector>
+#include <catch2/catch_test_macros.hpp>
+
+#include "pgm/factor.hpp"
+#include "pgm/structured_cpd.hpp"
+
+namespace
+{
+
+// Sums v out of the product of the factors that mention it.
+void eliminate(std::vector<pgm::factor>& factors, pgm::rv v)
+{
+  std::vector<pgm::factor> rest;
+  std::vector<pgm::factor> product;
+  for (const auto& f : factors) {
+    (f.scope_contains(v) ? product : rest).push_back(f);
+  }
+  auto joint = product.front();
+  for (std::size_t i = 1; i < product.size(); ++i) {
+    joint = pgm::factor_product(joint, product[i]);
+  }
+  rest.push_back(pgm::factor_marginalization(joint, v));
+  factors = rest;
+}
+
+auto joint_product(const std::vector<pgm::factor>& factors) -> pgm::factor
+{
+  auto joint = factors.front();
+  for (std::size_t i = 1; i < factors.size(); ++i) {
+    joint = pgm::factor_product(joint, factors[i]);
+  }
+  return joint;
+}
+
+}  // namespace
+
+TEST_CASE("Noisy-OR CPD", "[structured_cpd]")
+{
+  pgm::rv A(2), B(2), C(2), Y(2);
+  auto cpd = pgm::make_noisy_or(Y, {A, B, C}, {0.9, 0.5, 0.2}, 0.1);
+
+  SECTION("The dense form follows the noisy-OR rule")
+  {
+    auto dense = cpd.to_factor();
+    pgm::rv_evidence evidence;
+    evidence[A] = 1;
+    evidence[B] = 1;
+    evidence[C] = 0;
+    auto p_off = 0.9 * 0.1 * 0.5;
+    REQUIRE(is_close(pgm::factor_reduction(dense, evidence),
+                     pgm::factor(pgm::factor::rv_list {Y}, {{p_off, 1 - p_off}})));
+  }
+
+  SECTION("Summing out the auxiliary variable recovers the dense CPD")
+  {
+    auto decomposition = cpd.decompose();
+    eliminate(decomposition.factors, decomposition.auxiliary);
+    REQUIRE(is_close(joint_product(decomposition.factors), cpd.to_factor()));
+  }
+
+  SECTION("Elimination works on the decomposition directly")
+  {
+    std::vector<pgm::factor> priors {
+        pgm::factor(pgm::factor::rv_list {A}, {{0.3, 0.7}}),
+        pgm::factor(pgm::factor::rv_list {B}, {{0.6, 0.4}}),
+        pgm::factor(pgm::factor::rv_list {C}, {{0.5, 0.5}}),
+    };
+    auto dense_factors = priors;
+    dense_factors.push_back(cpd.to_factor());
+    auto decomposition = cpd.decompose();
+    auto factors = priors;
+    factors.insert(
+        factors.end(), decomposition.factors.begin(), decomposition.factors.end());
+
+    // No intermediate factor spans more than two variables.
+    for (auto v : {A, B, C, decomposition.auxiliary}) {
+      eliminate(factors, v);
+    }
+    for (auto v : {A, B, C}) {
+      eliminate(dense_factors, v);
+    }
+    REQUIRE(is_close(joint_product(factors), joint_product(dense_factors)));
+  }
+
+  SECTION("Noisy-OR variables must be binary")
+  {
+    pgm::rv D(3);
+    CHECK_THROWS_AS(pgm::make_noisy_or(Y, {D}, {0.5}), std::runtime_error);
+  }
+}
+
+TEST_CASE("Noisy-MAX CPD", "[structured_cpd]")
+{
+  pgm::rv A(3), Y(3);
+  pgm::noisy_max_cpd cpd(Y,
+                         {A},
+                         {{1., 0., 0., 0.2, 0.8, 0., 0.1, 0.3, 0.6}},
+                         {0.9, 0.1, 0.});
+  auto decomposition = cpd.decompose();
+  eliminate(decomposition.factors, decomposition.auxiliary);
+
+  // With A = 2: P(Y <= 0) = 0.9 * 0.1, P(Y <= 1) = 1.0 * 0.4.
+  pgm::factor expected(pgm::factor::rv_list {A, Y},
+                       {{0.9, 0.1, 0., 0.18, 0.82, 0., 0.09, 0.31, 0.6}});
+  CHECK(is_close(cpd.to_factor(), expected));
+  CHECK(is_close(joint_product(decomposition.factors), expected));
+}
+
+TEST_CASE("Tree CPD", "[structured_cpd]")
+{
+  // If A = 0 the child ignores B; otherwise it depends on B.
+  pgm::rv A(2), B(2), Y(2);
+  pgm::tree_cpd cpd(
+      Y,
+      pgm::tree_cpd::split(A,
+                           {pgm::tree_cpd::leaf({0.9, 0.1}),
+                            pgm::tree_cpd::split(
+                                B,
+                                {pgm::tree_cpd::leaf({0.6, 0.4}),
+                                 pgm::tree_cpd::leaf({0.2, 0.8})})}));
+  pgm::factor expected(pgm::factor::rv_list {A, B, Y},
+                       {{0.9, 0.1, 0.9, 0.1, 0.6, 0.4, 0.2, 0.8}});
+
+  SECTION("The dense form follows the tree")
+  {
+    CHECK(cpd.parents() == pgm::factor::rv_list {A, B});
+    REQUIRE(is_close(cpd.to_factor(), expected));
+  }
+
+  SECTION("The product of the rule factors is the CPD")
+  {
+    auto rules = cpd.rule_factors();
+    CHECK(rules.size() == 3);
+    CHECK(rules[0].vars() == pgm::factor::rv_list {A, Y});
+    REQUIRE(is_close(joint_product(rules), expected));
+  }
+
+  SECTION("Evidence prunes the tree")
+  {
+    pgm::rv_evidence evidence;
+    evidence[A] = 0;
+    auto reduced = cpd.reduction(evidence);
+    CHECK(reduced.parents().empty());
+    REQUIRE(is_close(reduced.to_factor(),
+                     pgm::factor(pgm::factor::rv_list {Y}, {{0.9, 0.1}})));
+  }
+
+  SECTION("Summing out a parent on the tree matches the dense CPD")
+  {
+    pgm::factor prior(pgm::factor::rv_list {A}, {{0.25, 0.75}});
+    auto summed = cpd.marginalization(A, prior);
+    CHECK(summed.parents() == pgm::factor::rv_list {B});
+    REQUIRE(is_close(
+        summed.to_factor(),
+        pgm::factor_marginalization(pgm::factor_product(prior, expected), A)));
+  }
+
+  SECTION("Each split needs one branch per value of its test")
+  {
+    CHECK_THROWS_AS(
+        pgm::tree_cpd(Y, pgm::tree_cpd::split(A, {pgm::tree_cpd::leaf({1., 0.})})),
+        std::runtime_error);
+  }
+}
+
+TEST_CASE("Tree CPD with Context-Specific Independence", "[structured_cpd]")
+{
+  // A chain-shaped tree: X_i only matters when X_0 .. X_{i-1} are all 0.
+  pgm::rv Y(2);
+  std::vector<pgm::rv> parents;
+  for (int i = 0; i < 8; ++i) {
+    parents.emplace_back(2);
+  }
+  auto node = pgm::tree_cpd::leaf({0.5, 0.5});
+  for (auto i = parents.size(); i-- > 0;) {
+    node = pgm::tree_cpd::split(
+        parents[i], {node, pgm::tree_cpd::leaf({0.1 * i, 1. - 0.1 * i})});
+  }
+  pgm::tree_cpd cpd(Y, node);
+  auto dense = cpd.to_factor();
+
+  CHECK(cpd.size() == 18);
+  CHECK(cpd.size() < dense.data().size());
+
+  pgm::factor prior(pgm::factor::rv_list {parents[0]}, {{0.4, 0.6}});
+  auto summed = cpd.marginalization(parents[0], prior);
+  CHECK(summed.size() < cpd.size());
+  REQUIRE(is_close(
+      summed.to_factor(),
+      pgm::factor_marginalization(pgm::factor_product(prior, dense),
+                                  parents[0])));
+}